@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Checks the sampled simulation against a full detailed run of the same
+# stationary trace: uniform random reads, in trace order.
+TRACE=$(mktemp)
+trap 'rm -f "$TRACE"' EXIT
+COUNT=400000
+INTERVAL=20000
+WARMUP=10000
+MEASURED=5000
+# on top of the confidence interval, in percent
+TOLERANCE=3
+
+python3 - "$TRACE" "$COUNT" <<'EOF'
+import random, sys
+random.seed(1)
+with open(sys.argv[1], 'w') as f:
+    for _ in range(int(sys.argv[2])):
+        f.write('{} R\n'.format(hex(random.randrange(1 << 28) << 6)))
+EOF
+
+# windows back to back with no warmup add up to the full detailed run
+full=$(./test -t "$TRACE" -s "$COUNT" -W 0 -M "$COUNT" |
+       grep -oP '(?<=estimated cycles )\d+')
+read est half < <(./test -t "$TRACE" -s "$INTERVAL" -W "$WARMUP" \
+                         -M "$MEASURED" |
+                  grep -oP '(?<=estimated cycles )\d+ \+- \d+' |
+                  sed 's/ +- / /')
+if [ -z "$full" ] || [ -z "$est" ]; then
+    echo "FAIL: no estimate"
+    exit 1
+fi
+
+error=$((est > full ? est - full : full - est))
+bound=$((half + full * TOLERANCE / 100))
+echo "full $full cycles, sampled $est +- $half cycles"
+if [ "$error" -gt "$bound" ]; then
+    echo "FAIL: off by $error cycles, more than $bound"
+    exit 1
+fi
+echo "PASS"
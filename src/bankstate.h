@@ -6,13 +6,33 @@
 
 namespace dramsim3 {
 
+// A view of one bank in ChannelState's flat bank tables, the state, open row
+// and row hit count live in per channel parallel arrays and the timing
+// constraints of the bank are kTimingStride consecutive entries of the
+// channel's timing matrix
 class BankState {
    public:
-    BankState();
-
     enum class State { OPEN, CLOSED, SREF, PD, SIZE };
+
+    // number of timing entries per bank, padded for vector updates
+    static const int kTimingStride = 12;
+
+    BankState(State& state, int& open_row, int& row_hit_count,
+              uint64_t* cmd_timing)
+        : state_(state),
+          cmd_timing_(cmd_timing),
+          open_row_(open_row),
+          row_hit_count_(row_hit_count) {}
     Command GetReadyCommand(const Command& cmd, uint64_t clk) const;
 
+    // The command that has to be issued next in order to serve cmd
+    CommandType GetRequiredCommandType(const Command& cmd) const;
+
+    // Earliest time when cmd_type can be executed in this bank
+    uint64_t GetCommandTiming(CommandType cmd_type) const {
+        return cmd_timing_[static_cast<int>(cmd_type)];
+    }
+
     // Update the state of the bank resulting after the execution of the command
     void UpdateState(const Command& cmd);
 
@@ -26,17 +46,20 @@ class BankState {
    private:
     // Current state of the Bank
     // Apriori or instantaneously transitions on a command.
-    State state_;
+    State& state_;
 
     // Earliest time when the particular Command can be executed in this bank
-    std::vector<uint64_t> cmd_timing_;
+    uint64_t* cmd_timing_;
 
     // Currently open row
-    int open_row_;
+    int& open_row_;
 
     // consecutive accesses to one row
-    int row_hit_count_;
+    int& row_hit_count_;
 };
 
+static_assert(BankState::kTimingStride >= static_cast<int>(CommandType::SIZE),
+              "timing stride must cover all command types");
+
 }  // namespace dramsim3
 #endif
@@ -1,32 +1,155 @@
 #include "channel_state.h"
+#include <algorithm>
+#include <limits>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 namespace dramsim3 {
+namespace {
+
+// timing[b][i] = max(timing[b][i], clk + delays[i]) for num_banks rows,
+// timings always fit in int64 so signed compares are fine
+void MaxUpdateScalar(uint64_t* timing, int num_banks, const int64_t* delays,
+                     uint64_t clk) {
+    int64_t times[BankState::kTimingStride];
+    for (int i = 0; i < BankState::kTimingStride; i++) {
+        times[i] = static_cast<int64_t>(clk) + delays[i];
+    }
+    for (int b = 0; b < num_banks; b++) {
+        int64_t* row =
+            reinterpret_cast<int64_t*>(timing) + b * BankState::kTimingStride;
+        for (int i = 0; i < BankState::kTimingStride; i++) {
+            row[i] = std::max(row[i], times[i]);
+        }
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DRAMSIM3_HAS_AVX2_KERNEL
+static_assert(BankState::kTimingStride == 12,
+              "AVX2 kernel updates 3 vectors of 4 timings per bank");
+
+__attribute__((target("avx2"))) void MaxUpdateAVX2(uint64_t* timing,
+                                                   int num_banks,
+                                                   const int64_t* delays,
+                                                   uint64_t clk) {
+    __m256i now = _mm256_set1_epi64x(static_cast<int64_t>(clk));
+    const __m256i* delay_vec = reinterpret_cast<const __m256i*>(delays);
+    __m256i t0 = _mm256_add_epi64(now, _mm256_loadu_si256(delay_vec));
+    __m256i t1 = _mm256_add_epi64(now, _mm256_loadu_si256(delay_vec + 1));
+    __m256i t2 = _mm256_add_epi64(now, _mm256_loadu_si256(delay_vec + 2));
+    for (int b = 0; b < num_banks; b++) {
+        __m256i* row = reinterpret_cast<__m256i*>(
+            timing + b * BankState::kTimingStride);
+        __m256i r0 = _mm256_loadu_si256(row);
+        __m256i r1 = _mm256_loadu_si256(row + 1);
+        __m256i r2 = _mm256_loadu_si256(row + 2);
+        r0 = _mm256_blendv_epi8(r0, t0, _mm256_cmpgt_epi64(t0, r0));
+        r1 = _mm256_blendv_epi8(r1, t1, _mm256_cmpgt_epi64(t1, r1));
+        r2 = _mm256_blendv_epi8(r2, t2, _mm256_cmpgt_epi64(t2, r2));
+        _mm256_storeu_si256(row, r0);
+        _mm256_storeu_si256(row + 1, r1);
+        _mm256_storeu_si256(row + 2, r2);
+    }
+}
+
+const bool kUseAVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+}  // namespace
+
 ChannelState::ChannelState(const Config& config, const Timing& timing)
     : rank_idle_cycles(config.ranks, 0),
       config_(config),
       timing_(timing),
       rank_is_sref_(config.ranks, false),
+      rank_versions_(config.ranks, 0),
+      bank_fsm_states_(config.ranks * config.banks, BankState::State::CLOSED),
+      open_rows_(config.ranks * config.banks, -1),
+      row_hit_counts_(config.ranks * config.banks, 0),
+      cmd_timing_(config.ranks * config.banks * BankState::kTimingStride, 0),
+      timing_updaters_(config.IsGDDR() ? MakeTimingUpdaters<true>()
+                                       : MakeTimingUpdaters<false>()),
       four_aw_(config_.ranks, std::vector<uint64_t>()),
-      thirty_two_aw_(config_.ranks, std::vector<uint64_t>()) {
-    bank_states_.reserve(config_.ranks);
-    for (auto i = 0; i < config_.ranks; i++) {
-        auto rank_states = std::vector<std::vector<BankState>>();
-        rank_states.reserve(config_.bankgroups);
+      thirty_two_aw_(config_.ranks, std::vector<uint64_t>()) {}
+
+void ChannelState::Checkpoint(CheckpointWriter& out) const {
+    out.Put(rank_idle_cycles);
+    out.Put(rank_is_sref_);
+    out.Put(rank_versions_);
+    out.Put(refresh_q_);
+    out.Put(static_cast<uint64_t>(bank_fsm_states_.size()));
+    for (auto state : bank_fsm_states_) {
+        out.Put(static_cast<int>(state));
+    }
+    out.Put(open_rows_);
+    out.Put(row_hit_counts_);
+    out.Put(cmd_timing_);
+    out.Put(four_aw_);
+    out.Put(thirty_two_aw_);
+}
+
+void ChannelState::Restore(CheckpointReader& in) {
+    in.Get(rank_idle_cycles);
+    in.Get(rank_is_sref_);
+    in.Get(rank_versions_);
+    in.Get(refresh_q_);
+    in.Expect(bank_fsm_states_.size(), "banks");
+    for (auto& state : bank_fsm_states_) {
+        int value;
+        in.Get(value);
+        state = static_cast<BankState::State>(value);
+    }
+    in.Get(open_rows_);
+    in.Get(row_hit_counts_);
+    in.Get(cmd_timing_);
+    in.Get(four_aw_);
+    in.Get(thirty_two_aw_);
+}
+
+void ChannelState::FunctionalUpdate(const Command& cmd) {
+    if (cmd.IsRankCMD()) {
         for (auto j = 0; j < config_.bankgroups; j++) {
-            auto bg_states =
-                std::vector<BankState>(config_.banks_per_group, BankState());
-            rank_states.push_back(bg_states);
+            for (auto k = 0; k < config_.banks_per_group; k++) {
+                if (GetBank(cmd.Rank(), j, k).IsRowOpen()) {
+                    Address addr = Address(-1, cmd.Rank(), j, k, -1, -1);
+                    UpdateState(Command(CommandType::PRECHARGE, addr, -1));
+                }
+            }
+        }
+        UpdateState(cmd);
+        return;
+    }
+    CommandType required;
+    do {
+        required = GetBank(cmd.Rank(), cmd.Bankgroup(), cmd.Bank())
+                       .GetRequiredCommandType(cmd);
+        UpdateState(Command(required, cmd.addr, cmd.hex_addr, cmd.id));
+    } while (required != cmd.cmd_type);
+    return;
+}
+
+void ChannelState::FunctionalRefresh() {
+    while (!refresh_q_.empty()) {
+        Command ref = refresh_q_.front();
+        if (rank_is_sref_[ref.Rank()]) {
+            // self refresh takes care of it
+            refresh_q_.erase(refresh_q_.begin());
+            continue;
         }
-        bank_states_.push_back(rank_states);
+        // issuing the refresh takes it off the queue
+        FunctionalUpdate(ref);
     }
+    return;
 }
 
 bool ChannelState::IsAllBankIdleInRank(int rank) const {
-    for (int j = 0; j < config_.bankgroups; j++) {
-        for (int k = 0; k < config_.banks_per_group; k++) {
-            if (bank_states_[rank][j][k].IsRowOpen()) {
-                return false;
-            }
+    int first = GetBankIndex(rank, 0, 0);
+    for (int i = first; i < first + config_.banks; i++) {
+        if (bank_fsm_states_[i] == BankState::State::OPEN) {
+            return false;
         }
     }
     return true;
@@ -38,7 +161,7 @@ bool ChannelState::IsRWPendingOnRef(const Command& cmd) const {
     int bank = cmd.Bank();
     return (IsRowOpen(rank, bankgroup, bank) &&
             RowHitCount(rank, bankgroup, bank) == 0 &&
-            bank_states_[rank][bankgroup][bank].OpenRow() == cmd.Row());
+            OpenRow(rank, bankgroup, bank) == cmd.Row());
 }
 
 void ChannelState::BankNeedRefresh(int rank, int bankgroup, int bank,
@@ -79,8 +202,7 @@ Command ChannelState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
         int num_ready = 0;
         for (auto j = 0; j < config_.bankgroups; j++) {
             for (auto k = 0; k < config_.banks_per_group; k++) {
-                ready_cmd =
-                    bank_states_[cmd.Rank()][j][k].GetReadyCommand(cmd, clk);
+                ready_cmd = GetBank(cmd.Rank(), j, k).GetReadyCommand(cmd, clk);
                 if (!ready_cmd.IsValid()) {  // Not ready
                     continue;
                 }
@@ -100,7 +222,7 @@ Command ChannelState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
             return Command();
         }
     } else {
-        ready_cmd = bank_states_[cmd.Rank()][cmd.Bankgroup()][cmd.Bank()]
+        ready_cmd = GetBank(cmd.Rank(), cmd.Bankgroup(), cmd.Bank())
                         .GetReadyCommand(cmd, clk);
         if (!ready_cmd.IsValid()) {
             return Command();
@@ -114,11 +236,36 @@ Command ChannelState::GetReadyCommand(const Command& cmd, uint64_t clk) const {
     }
 }
 
+uint64_t ChannelState::EarliestReadyCycle(const Command& cmd) const {
+    if (cmd.IsRankCMD()) {
+        // the first bank to become ready (e.g. to precharge) is the bound
+        uint64_t ready_cycle = std::numeric_limits<uint64_t>::max();
+        for (auto j = 0; j < config_.bankgroups; j++) {
+            for (auto k = 0; k < config_.banks_per_group; k++) {
+                const auto bank_state = GetBank(cmd.Rank(), j, k);
+                auto required_type = bank_state.GetRequiredCommandType(cmd);
+                ready_cycle = std::min(
+                    ready_cycle, bank_state.GetCommandTiming(required_type));
+            }
+        }
+        return ready_cycle;
+    }
+    const auto bank_state = GetBank(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
+    auto required_type = bank_state.GetRequiredCommandType(cmd);
+    uint64_t ready_cycle = bank_state.GetCommandTiming(required_type);
+    if (required_type == CommandType::ACTIVATE) {
+        ready_cycle =
+            std::max(ready_cycle, ActivationWindowReadyCycle(cmd.Rank()));
+    }
+    return ready_cycle;
+}
+
 void ChannelState::UpdateState(const Command& cmd) {
+    rank_versions_[cmd.Rank()]++;
     if (cmd.IsRankCMD()) {
         for (auto j = 0; j < config_.bankgroups; j++) {
             for (auto k = 0; k < config_.banks_per_group; k++) {
-                bank_states_[cmd.Rank()][j][k].UpdateState(cmd);
+                GetBank(cmd.Rank(), j, k).UpdateState(cmd);
             }
         }
         if (cmd.IsRefresh()) {
@@ -129,7 +276,7 @@ void ChannelState::UpdateState(const Command& cmd) {
             rank_is_sref_[cmd.Rank()] = false;
         }
     } else {
-        bank_states_[cmd.Rank()][cmd.Bankgroup()][cmd.Bank()].UpdateState(cmd);
+        GetBank(cmd.Rank(), cmd.Bankgroup(), cmd.Bank()).UpdateState(cmd);
         if (cmd.IsRefresh()) {
             BankNeedRefresh(cmd.Rank(), cmd.Bankgroup(), cmd.Bank(), false);
         }
@@ -138,127 +285,130 @@ void ChannelState::UpdateState(const Command& cmd) {
 }
 
 void ChannelState::UpdateTiming(const Command& cmd, uint64_t clk) {
-    switch (cmd.cmd_type) {
-        case CommandType::ACTIVATE:
-            UpdateActivationTimes(cmd.Rank(), clk);
-        case CommandType::READ:
-        case CommandType::READ_PRECHARGE:
-        case CommandType::WRITE:
-        case CommandType::WRITE_PRECHARGE:
-        case CommandType::PRECHARGE:
-        case CommandType::REFRESH_BANK:
-            // TODO - simulator speed? - Speciazlize which of the below
-            // functions to call depending on the command type  Same Bank
-            UpdateSameBankTiming(
-                cmd.addr, timing_.same_bank[static_cast<int>(cmd.cmd_type)],
-                clk);
-
-            // Same Bankgroup other banks
-            UpdateOtherBanksSameBankgroupTiming(
-                cmd.addr,
-                timing_
-                    .other_banks_same_bankgroup[static_cast<int>(cmd.cmd_type)],
-                clk);
-
-            // Other bankgroups
-            UpdateOtherBankgroupsSameRankTiming(
-                cmd.addr,
-                timing_
-                    .other_bankgroups_same_rank[static_cast<int>(cmd.cmd_type)],
-                clk);
-
-            // Other ranks
-            UpdateOtherRanksTiming(
-                cmd.addr, timing_.other_ranks[static_cast<int>(cmd.cmd_type)],
-                clk);
-            break;
-        case CommandType::REFRESH:
-        case CommandType::SREF_ENTER:
-        case CommandType::SREF_EXIT:
-            UpdateSameRankTiming(
-                cmd.addr, timing_.same_rank[static_cast<int>(cmd.cmd_type)],
-                clk);
-            break;
-        default:
-            AbruptExit(__FILE__, __LINE__);
+    if (cmd.cmd_type >= CommandType::SIZE) {
+        AbruptExit(__FILE__, __LINE__);
+    }
+    (this->*timing_updaters_[static_cast<int>(cmd.cmd_type)])(cmd, clk);
+    if (!cmd.IsRankCMD() &&
+        !timing_.other_ranks[static_cast<int>(cmd.cmd_type)].empty()) {
+        for (auto& version : rank_versions_) {
+            version++;
+        }
+    } else {
+        rank_versions_[cmd.Rank()]++;
     }
     return;
 }
 
-void ChannelState::UpdateSameBankTiming(
-    const Address& addr,
-    const std::vector<std::pair<CommandType, int>>& cmd_timing_list,
-    uint64_t clk) {
-    for (auto cmd_timing : cmd_timing_list) {
-        bank_states_[addr.rank][addr.bankgroup][addr.bank].UpdateTiming(
-            cmd_timing.first, clk + cmd_timing.second);
+template <bool kIsGDDR>
+std::array<ChannelState::TimingUpdater, static_cast<int>(CommandType::SIZE)>
+ChannelState::MakeTimingUpdaters() {
+    std::array<TimingUpdater, static_cast<int>(CommandType::SIZE)> updaters;
+    updaters[static_cast<int>(CommandType::READ)] =
+        &ChannelState::UpdateTimingFor<CommandType::READ, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::READ_PRECHARGE)] =
+        &ChannelState::UpdateTimingFor<CommandType::READ_PRECHARGE, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::WRITE)] =
+        &ChannelState::UpdateTimingFor<CommandType::WRITE, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::WRITE_PRECHARGE)] =
+        &ChannelState::UpdateTimingFor<CommandType::WRITE_PRECHARGE, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::ACTIVATE)] =
+        &ChannelState::UpdateTimingFor<CommandType::ACTIVATE, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::PRECHARGE)] =
+        &ChannelState::UpdateTimingFor<CommandType::PRECHARGE, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::REFRESH_BANK)] =
+        &ChannelState::UpdateTimingFor<CommandType::REFRESH_BANK, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::REFRESH)] =
+        &ChannelState::UpdateTimingFor<CommandType::REFRESH, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::SREF_ENTER)] =
+        &ChannelState::UpdateTimingFor<CommandType::SREF_ENTER, kIsGDDR>;
+    updaters[static_cast<int>(CommandType::SREF_EXIT)] =
+        &ChannelState::UpdateTimingFor<CommandType::SREF_EXIT, kIsGDDR>;
+    return updaters;
+}
+
+template <CommandType kCmd, bool kIsGDDR>
+void ChannelState::UpdateTimingFor(const Command& cmd, uint64_t clk) {
+    const int row = static_cast<int>(kCmd);
+    if (kCmd == CommandType::REFRESH || kCmd == CommandType::SREF_ENTER ||
+        kCmd == CommandType::SREF_EXIT) {
+        // rank level commands
+        UpdateSameRankTiming(cmd.addr, timing_.same_rank_delays[row].data(),
+                             clk);
+        return;
+    }
+    if (kCmd == CommandType::ACTIVATE) {
+        UpdateActivationWindows<kIsGDDR>(cmd.Rank(), clk);
     }
+    UpdateSameBankTiming(cmd.addr, timing_.same_bank_delays[row].data(), clk);
+    UpdateOtherBanksSameBankgroupTiming(
+        cmd.addr, timing_.other_banks_same_bankgroup_delays[row].data(), clk);
+    UpdateOtherBankgroupsSameRankTiming(
+        cmd.addr, timing_.other_bankgroups_same_rank_delays[row].data(), clk);
+    UpdateOtherRanksTiming(cmd.addr, timing_.other_ranks_delays[row].data(),
+                           clk);
     return;
 }
 
-void ChannelState::UpdateOtherBanksSameBankgroupTiming(
-    const Address& addr,
-    const std::vector<std::pair<CommandType, int>>& cmd_timing_list,
-    uint64_t clk) {
-    for (auto k = 0; k < config_.banks_per_group; k++) {
-        if (k != addr.bank) {
-            for (auto cmd_timing : cmd_timing_list) {
-                bank_states_[addr.rank][addr.bankgroup][k].UpdateTiming(
-                    cmd_timing.first, clk + cmd_timing.second);
-            }
-        }
+void ChannelState::UpdateBankRangeTiming(int first, int last,
+                                         const int64_t* delays, uint64_t clk) {
+    if (first >= last) {
+        return;
+    }
+    uint64_t* timing = &cmd_timing_[first * BankState::kTimingStride];
+#ifdef DRAMSIM3_HAS_AVX2_KERNEL
+    if (kUseAVX2) {
+        MaxUpdateAVX2(timing, last - first, delays, clk);
+        return;
     }
+#endif
+    MaxUpdateScalar(timing, last - first, delays, clk);
     return;
 }
 
-void ChannelState::UpdateOtherBankgroupsSameRankTiming(
-    const Address& addr,
-    const std::vector<std::pair<CommandType, int>>& cmd_timing_list,
-    uint64_t clk) {
-    for (auto j = 0; j < config_.bankgroups; j++) {
-        if (j != addr.bankgroup) {
-            for (auto k = 0; k < config_.banks_per_group; k++) {
-                for (auto cmd_timing : cmd_timing_list) {
-                    bank_states_[addr.rank][j][k].UpdateTiming(
-                        cmd_timing.first, clk + cmd_timing.second);
-                }
-            }
-        }
-    }
+void ChannelState::UpdateSameBankTiming(const Address& addr,
+                                        const int64_t* delays, uint64_t clk) {
+    int bank = GetBankIndex(addr.rank, addr.bankgroup, addr.bank);
+    UpdateBankRangeTiming(bank, bank + 1, delays, clk);
     return;
 }
 
-void ChannelState::UpdateOtherRanksTiming(
-    const Address& addr,
-    const std::vector<std::pair<CommandType, int>>& cmd_timing_list,
-    uint64_t clk) {
-    for (auto i = 0; i < config_.ranks; i++) {
-        if (i != addr.rank) {
-            for (auto j = 0; j < config_.bankgroups; j++) {
-                for (auto k = 0; k < config_.banks_per_group; k++) {
-                    for (auto cmd_timing : cmd_timing_list) {
-                        bank_states_[i][j][k].UpdateTiming(
-                            cmd_timing.first, clk + cmd_timing.second);
-                    }
-                }
-            }
-        }
-    }
+void ChannelState::UpdateOtherBanksSameBankgroupTiming(const Address& addr,
+                                                       const int64_t* delays,
+                                                       uint64_t clk) {
+    int first = GetBankIndex(addr.rank, addr.bankgroup, 0);
+    int bank = first + addr.bank;
+    UpdateBankRangeTiming(first, bank, delays, clk);
+    UpdateBankRangeTiming(bank + 1, first + config_.banks_per_group, delays,
+                          clk);
     return;
 }
 
-void ChannelState::UpdateSameRankTiming(
-    const Address& addr,
-    const std::vector<std::pair<CommandType, int>>& cmd_timing_list,
-    uint64_t clk) {
-    for (auto j = 0; j < config_.bankgroups; j++) {
-        for (auto k = 0; k < config_.banks_per_group; k++) {
-            for (auto cmd_timing : cmd_timing_list) {
-                bank_states_[addr.rank][j][k].UpdateTiming(
-                    cmd_timing.first, clk + cmd_timing.second);
-            }
-        }
-    }
+void ChannelState::UpdateOtherBankgroupsSameRankTiming(const Address& addr,
+                                                       const int64_t* delays,
+                                                       uint64_t clk) {
+    int first = GetBankIndex(addr.rank, 0, 0);
+    int bankgroup = GetBankIndex(addr.rank, addr.bankgroup, 0);
+    UpdateBankRangeTiming(first, bankgroup, delays, clk);
+    UpdateBankRangeTiming(bankgroup + config_.banks_per_group,
+                          first + config_.banks, delays, clk);
+    return;
+}
+
+void ChannelState::UpdateOtherRanksTiming(const Address& addr,
+                                          const int64_t* delays,
+                                          uint64_t clk) {
+    int rank = GetBankIndex(addr.rank, 0, 0);
+    UpdateBankRangeTiming(0, rank, delays, clk);
+    UpdateBankRangeTiming(rank + config_.banks, config_.ranks * config_.banks,
+                          delays, clk);
+    return;
+}
+
+void ChannelState::UpdateSameRankTiming(const Address& addr,
+                                        const int64_t* delays, uint64_t clk) {
+    int rank = GetBankIndex(addr.rank, 0, 0);
+    UpdateBankRangeTiming(rank, rank + config_.banks, delays, clk);
     return;
 }
 
@@ -280,11 +430,21 @@ bool ChannelState::ActivationWindowOk(int rank, uint64_t curr_time) const {
 }
 
 void ChannelState::UpdateActivationTimes(int rank, uint64_t curr_time) {
+    if (config_.IsGDDR()) {
+        UpdateActivationWindows<true>(rank, curr_time);
+    } else {
+        UpdateActivationWindows<false>(rank, curr_time);
+    }
+    return;
+}
+
+template <bool kIsGDDR>
+void ChannelState::UpdateActivationWindows(int rank, uint64_t curr_time) {
     if (!four_aw_[rank].empty() && curr_time >= four_aw_[rank][0]) {
         four_aw_[rank].erase(four_aw_[rank].begin());
     }
     four_aw_[rank].push_back(curr_time + config_.tFAW);
-    if (config_.IsGDDR()) {
+    if (kIsGDDR) {
         if (!thirty_two_aw_[rank].empty() &&
             curr_time >= thirty_two_aw_[rank][0]) {
             thirty_two_aw_[rank].erase(thirty_two_aw_[rank].begin());
@@ -313,4 +473,15 @@ bool ChannelState::Is32AWReady(int rank, uint64_t curr_time) const {
     return true;
 }
 
+uint64_t ChannelState::ActivationWindowReadyCycle(int rank) const {
+    uint64_t ready_cycle = 0;
+    if (four_aw_[rank].size() >= 4) {
+        ready_cycle = four_aw_[rank][0];
+    }
+    if (config_.IsGDDR() && thirty_two_aw_[rank].size() >= 32) {
+        ready_cycle = std::max(ready_cycle, thirty_two_aw_[rank][0]);
+    }
+    return ready_cycle;
+}
+
 }  // namespace dramsim3
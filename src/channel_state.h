@@ -1,8 +1,11 @@
 #ifndef __CHANNEL_STATE_H
 #define __CHANNEL_STATE_H
 
+#include <stdint.h>
+#include <array>
 #include <vector>
 #include "bankstate.h"
+#include "checkpoint.h"
 #include "common.h"
 #include "configuration.h"
 #include "timing.h"
@@ -13,13 +16,20 @@ class ChannelState {
    public:
     ChannelState(const Config& config, const Timing& timing);
     Command GetReadyCommand(const Command& cmd, uint64_t clk) const;
+    // Lower bound of the cycle GetReadyCommand() can return a valid command
+    uint64_t EarliestReadyCycle(const Command& cmd) const;
     void UpdateState(const Command& cmd);
     void UpdateTiming(const Command& cmd, uint64_t clk);
     void UpdateTimingAndStates(const Command& cmd, uint64_t clk);
+    // Functional model: apply cmd and whatever has to be issued before it to
+    // the bank (or rank) states, without any timing
+    void FunctionalUpdate(const Command& cmd);
+    // functionally issue every waiting refresh
+    void FunctionalRefresh();
     bool ActivationWindowOk(int rank, uint64_t curr_time) const;
     void UpdateActivationTimes(int rank, uint64_t curr_time);
     bool IsRowOpen(int rank, int bankgroup, int bank) const {
-        return bank_states_[rank][bankgroup][bank].IsRowOpen();
+        return GetBank(rank, bankgroup, bank).IsRowOpen();
     }
     bool IsAllBankIdleInRank(int rank) const;
     bool IsRankSelfRefreshing(int rank) const { return rank_is_sref_[rank]; }
@@ -29,12 +39,19 @@ class ChannelState {
     void BankNeedRefresh(int rank, int bankgroup, int bank, bool need);
     void RankNeedRefresh(int rank, bool need);
     int OpenRow(int rank, int bankgroup, int bank) const {
-        return bank_states_[rank][bankgroup][bank].OpenRow();
+        return GetBank(rank, bankgroup, bank).OpenRow();
     }
     int RowHitCount(int rank, int bankgroup, int bank) const {
-        return bank_states_[rank][bankgroup][bank].RowHitCount();
+        return GetBank(rank, bankgroup, bank).RowHitCount();
     };
 
+    // Bumped whenever the state or timing of a bank in the rank changes, so
+    // anything derived from them can be cached until the version moves
+    uint64_t RankVersion(int rank) const { return rank_versions_[rank]; }
+
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
+
     std::vector<int> rank_idle_cycles;
 
    private:
@@ -42,43 +59,80 @@ class ChannelState {
     const Timing& timing_;
 
     std::vector<bool> rank_is_sref_;
-    std::vector<std::vector<std::vector<BankState> > > bank_states_;
+    std::vector<uint64_t> rank_versions_;
     std::vector<Command> refresh_q_;
 
+    // Flat bank tables indexed by GetBankIndex(), the timing matrix holds
+    // BankState::kTimingStride entries per bank, i.e. it is laid out as
+    // [rank][bankgroup][bank][command type]
+    std::vector<BankState::State> bank_fsm_states_;
+    std::vector<int> open_rows_;
+    std::vector<int> row_hit_counts_;
+    std::vector<uint64_t> cmd_timing_;
+
+    // UpdateTiming() specialized per command type and protocol family, picked
+    // once at construction so issuing a command is a single indirect call
+    using TimingUpdater = void (ChannelState::*)(const Command& cmd,
+                                                 uint64_t clk);
+    std::array<TimingUpdater, static_cast<int>(CommandType::SIZE)>
+        timing_updaters_;
+    template <bool kIsGDDR>
+    static std::array<TimingUpdater, static_cast<int>(CommandType::SIZE)>
+    MakeTimingUpdaters();
+    template <CommandType kCmd, bool kIsGDDR>
+    void UpdateTimingFor(const Command& cmd, uint64_t clk);
+    template <bool kIsGDDR>
+    void UpdateActivationWindows(int rank, uint64_t curr_time);
+
+    int GetBankIndex(int rank, int bankgroup, int bank) const {
+        return (rank * config_.bankgroups + bankgroup) *
+                   config_.banks_per_group +
+               bank;
+    }
+    BankState GetBank(int rank, int bankgroup, int bank) {
+        int index = GetBankIndex(rank, bankgroup, bank);
+        return BankState(bank_fsm_states_[index], open_rows_[index],
+                         row_hit_counts_[index],
+                         &cmd_timing_[index * BankState::kTimingStride]);
+    }
+    const BankState GetBank(int rank, int bankgroup, int bank) const {
+        return const_cast<ChannelState*>(this)->GetBank(rank, bankgroup, bank);
+    }
+
+    // Apply a delay row to the timing of banks [first, last)
+    void UpdateBankRangeTiming(int first, int last, const int64_t* delays,
+                               uint64_t clk);
+
     std::vector<std::vector<uint64_t> > four_aw_;
     std::vector<std::vector<uint64_t> > thirty_two_aw_;
     bool IsFAWReady(int rank, uint64_t curr_time) const;
     bool Is32AWReady(int rank, uint64_t curr_time) const;
+    uint64_t ActivationWindowReadyCycle(int rank) const;
     // Update timing of the bank the command corresponds to
     void UpdateSameBankTiming(
         const Address& addr,
-        const std::vector<std::pair<CommandType, int> >& cmd_timing_list,
-        uint64_t clk);
+        const int64_t* delays, uint64_t clk);
 
     // Update timing of the other banks in the same bankgroup as the command
     void UpdateOtherBanksSameBankgroupTiming(
         const Address& addr,
-        const std::vector<std::pair<CommandType, int> >& cmd_timing_list,
-        uint64_t clk);
+        const int64_t* delays, uint64_t clk);
 
     // Update timing of banks in the same rank but different bankgroup as the
     // command
     void UpdateOtherBankgroupsSameRankTiming(
         const Address& addr,
-        const std::vector<std::pair<CommandType, int> >& cmd_timing_list,
-        uint64_t clk);
+        const int64_t* delays, uint64_t clk);
 
     // Update timing of banks in a different rank as the command
     void UpdateOtherRanksTiming(
         const Address& addr,
-        const std::vector<std::pair<CommandType, int> >& cmd_timing_list,
-        uint64_t clk);
+        const int64_t* delays, uint64_t clk);
 
     // Update timing of the entire rank (for rank level commands)
     void UpdateSameRankTiming(
         const Address& addr,
-        const std::vector<std::pair<CommandType, int> >& cmd_timing_list,
-        uint64_t clk);
+        const int64_t* delays, uint64_t clk);
 };
 
 }  // namespace dramsim3
@@ -0,0 +1,202 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace dramsim3 {
+
+namespace {
+const char kCheckpointMagic[8] = {'D', 'S', '3', 'C', 'K', 'P', 'T', '\0'};
+
+void Corrupted() {
+    std::cerr << "Corrupted checkpoint" << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+}
+}  // namespace
+
+void CheckpointWriter::Put(uint64_t value) {
+    while (value >= 0x80) {
+        data_.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    data_.push_back(static_cast<uint8_t>(value));
+}
+
+void CheckpointWriter::Put(int64_t value) {
+    uint64_t bits = static_cast<uint64_t>(value);
+    Put((bits << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void CheckpointWriter::Put(const Address& addr) {
+    Put(addr.channel);
+    Put(addr.rank);
+    Put(addr.bankgroup);
+    Put(addr.bank);
+    Put(addr.row);
+    Put(addr.column);
+}
+
+void CheckpointWriter::Put(const Command& cmd) {
+    Put(static_cast<int>(cmd.cmd_type));
+    Put(cmd.addr);
+    Put(cmd.hex_addr);
+    Put(cmd.id);
+}
+
+void CheckpointWriter::Put(const Transaction& trans) {
+    Put(trans.id);
+    Put(trans.tag);
+    Put(trans.addr);
+    Put(trans.mapped_addr);
+    Put(trans.added_cycle);
+    Put(trans.complete_cycle);
+    Put(trans.is_write);
+}
+
+bool CheckpointWriter::WriteFile(const std::string& file_name,
+                                 uint64_t config_hash) const {
+    std::FILE* file = std::fopen(file_name.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Can't open " << file_name << std::endl;
+        return false;
+    }
+    CheckpointHeader header;
+    std::memcpy(header.magic, kCheckpointMagic, sizeof(kCheckpointMagic));
+    header.version = kCheckpointVersion;
+    header.reserved = 0;
+    header.config_hash = config_hash;
+    header.size = data_.size();
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(data_.data(), 1, data_.size(), file) == data_.size();
+    ok &= std::fclose(file) == 0;
+    if (!ok) {
+        std::cerr << "Can't write checkpoint " << file_name << std::endl;
+    }
+    return ok;
+}
+
+bool CheckpointReader::ReadFile(const std::string& file_name,
+                                uint64_t config_hash) {
+    std::FILE* file = std::fopen(file_name.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Can't open checkpoint " << file_name << std::endl;
+        return false;
+    }
+    CheckpointHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1 &&
+              std::memcmp(header.magic, kCheckpointMagic,
+                          sizeof(kCheckpointMagic)) == 0 &&
+              header.version == kCheckpointVersion;
+    if (!ok) {
+        std::cerr << "Unsupported checkpoint " << file_name << std::endl;
+    } else if (header.config_hash != config_hash) {
+        std::cerr << "Checkpoint " << file_name
+                  << " was taken with a different config" << std::endl;
+        ok = false;
+    } else {
+        data_.resize(header.size);
+        pos_ = 0;
+        ok = std::fread(data_.data(), 1, data_.size(), file) == data_.size();
+        if (!ok) {
+            std::cerr << "Truncated checkpoint " << file_name << std::endl;
+        }
+    }
+    std::fclose(file);
+    return ok;
+}
+
+void CheckpointReader::Get(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && pos_ < data_.size(); shift += 7) {
+        uint8_t byte = data_[pos_++];
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return;
+        }
+    }
+    Corrupted();
+}
+
+void CheckpointReader::Get(int64_t& value) {
+    uint64_t bits;
+    Get(bits);
+    value = static_cast<int64_t>((bits >> 1) ^ (0 - (bits & 1)));
+}
+
+void CheckpointReader::Get(int& value) {
+    int64_t wide;
+    Get(wide);
+    value = static_cast<int>(wide);
+}
+
+void CheckpointReader::Get(bool& value) {
+    uint64_t bits;
+    Get(bits);
+    if (bits > 1) {
+        Corrupted();
+    }
+    value = bits != 0;
+}
+
+void CheckpointReader::Get(Address& addr) {
+    Get(addr.channel);
+    Get(addr.rank);
+    Get(addr.bankgroup);
+    Get(addr.bank);
+    Get(addr.row);
+    Get(addr.column);
+}
+
+void CheckpointReader::Get(Command& cmd) {
+    int cmd_type;
+    Get(cmd_type);
+    if (cmd_type < 0 || cmd_type >= static_cast<int>(CommandType::SIZE)) {
+        Corrupted();
+    }
+    cmd.cmd_type = static_cast<CommandType>(cmd_type);
+    Get(cmd.addr);
+    Get(cmd.hex_addr);
+    Get(cmd.id);
+}
+
+void CheckpointReader::Get(Transaction& trans) {
+    Get(trans.id);
+    Get(trans.tag);
+    Get(trans.addr);
+    Get(trans.mapped_addr);
+    Get(trans.added_cycle);
+    Get(trans.complete_cycle);
+    Get(trans.is_write);
+}
+
+void CheckpointReader::Get(std::vector<bool>& vec) {
+    vec.resize(GetSize());
+    for (size_t i = 0; i < vec.size(); i++) {
+        bool value;
+        Get(value);
+        vec[i] = value;
+    }
+}
+
+size_t CheckpointReader::GetSize() {
+    uint64_t size;
+    Get(size);
+    // every element takes at least a byte
+    if (size > data_.size() - pos_) {
+        Corrupted();
+    }
+    return size;
+}
+
+void CheckpointReader::Expect(uint64_t expected, const char* what) {
+    uint64_t value;
+    Get(value);
+    if (value != expected) {
+        std::cerr << "Checkpoint has " << value << " " << what << ", expected "
+                  << expected << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,87 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "common.h"
+
+namespace dramsim3 {
+
+// Checkpoint layout: a CheckpointHeader followed by the payload, which is
+// whatever the Checkpoint() members of the simulator classes put in, in the
+// order they put it. Integers are varints (signed ones zigzag encoded) so
+// cycle numbers, counters and addresses only take the bytes they need.
+// A checkpoint can only be restored into a simulator built from a config
+// with the same hash, see Config::hash.
+const uint32_t kCheckpointVersion = 3;
+
+struct CheckpointHeader {
+    char magic[8];  // "DS3CKPT"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t config_hash;
+    uint64_t size;  // payload bytes
+};
+
+class CheckpointWriter {
+   public:
+    void Put(uint64_t value);
+    void Put(int64_t value);
+    void Put(int value) { Put(static_cast<int64_t>(value)); }
+    void Put(bool value) { Put(static_cast<uint64_t>(value)); }
+    void Put(const Address& addr);
+    void Put(const Command& cmd);
+    void Put(const Transaction& trans);
+    template <typename T>
+    void Put(const std::vector<T>& vec) {
+        Put(static_cast<uint64_t>(vec.size()));
+        for (const T& value : vec) {
+            Put(value);
+        }
+    }
+
+    bool WriteFile(const std::string& file_name, uint64_t config_hash) const;
+
+   private:
+    std::vector<uint8_t> data_;
+};
+
+// Reads back what a CheckpointWriter wrote, in the same order. Running past
+// the end of the payload or reading a malformed value is fatal.
+class CheckpointReader {
+   public:
+    CheckpointReader() : pos_(0) {}
+    // false if the file can't be read, isn't a checkpoint of this version or
+    // was taken with another config
+    bool ReadFile(const std::string& file_name, uint64_t config_hash);
+    bool AtEnd() const { return pos_ == data_.size(); }
+
+    void Get(uint64_t& value);
+    void Get(int64_t& value);
+    void Get(int& value);
+    void Get(bool& value);
+    void Get(Address& addr);
+    void Get(Command& cmd);
+    void Get(Transaction& trans);
+    void Get(std::vector<bool>& vec);
+    template <typename T>
+    void Get(std::vector<T>& vec) {
+        vec.resize(GetSize());
+        for (T& value : vec) {
+            Get(value);
+        }
+    }
+    // a container size, checked against what is left of the payload
+    size_t GetSize();
+    // values that must match the restoring simulator, e.g. the number of
+    // queues the checkpoint holds
+    void Expect(uint64_t expected, const char* what);
+
+   private:
+    std::vector<uint8_t> data_;
+    size_t pos_;
+};
+
+}  // namespace dramsim3
+#endif
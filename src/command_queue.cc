@@ -1,4 +1,6 @@
 #include "command_queue.h"
+#include <algorithm>
+#include <limits>
 
 namespace dramsim3 {
 
@@ -9,6 +11,10 @@ CommandQueue::CommandQueue(int channel_id, const Config& config,
       config_(config),
       channel_state_(channel_state),
       simple_stats_(simple_stats),
+      counted_rows_(config.ranks * config.banks, -1),
+      row_hits_(config.ranks * config.banks, 0),
+      bank_scan_stamps_(config.ranks * config.banks, 0),
+      scan_id_(0),
       is_in_ref_(false),
       queue_size_(static_cast<size_t>(config_.cmd_queue_size)),
       queue_idx_(0),
@@ -30,7 +36,58 @@ CommandQueue::CommandQueue(int channel_id, const Config& config,
         auto cmd_queue = std::vector<Command>();
         cmd_queue.reserve(config_.cmd_queue_size);
         queues_.push_back(cmd_queue);
+        queue_ranks_.push_back(queue_structure_ == QueueStructure::PER_RANK
+                                   ? i
+                                   : i / config_.banks);
     }
+    // empty queues are never ready, the stale versions force a recompute
+    // for anything else
+    queue_ready_cycles_.resize(num_queues_,
+                               std::numeric_limits<uint64_t>::max());
+    queue_rank_versions_.resize(num_queues_,
+                                std::numeric_limits<uint64_t>::max());
+    queued_reads_.resize(num_queues_, 0);
+}
+
+void CommandQueue::Checkpoint(CheckpointWriter& out) const {
+    out.Put(queues_);
+    out.Put(queue_ready_cycles_);
+    out.Put(queue_rank_versions_);
+    out.Put(counted_rows_);
+    out.Put(row_hits_);
+    out.Put(queued_reads_);
+    out.Put(bank_scan_stamps_);
+    out.Put(scan_id_);
+    std::vector<int> ref_q_indices(ref_q_indices_.begin(),
+                                   ref_q_indices_.end());
+    std::sort(ref_q_indices.begin(), ref_q_indices.end());
+    out.Put(ref_q_indices);
+    out.Put(is_in_ref_);
+    out.Put(queue_idx_);
+    out.Put(clk_);
+    out.Put(rank_q_empty);
+}
+
+void CommandQueue::Restore(CheckpointReader& in) {
+    in.Expect(queues_.size(), "command queues");
+    for (auto& queue : queues_) {
+        in.Get(queue);
+    }
+    in.Get(queue_ready_cycles_);
+    in.Get(queue_rank_versions_);
+    in.Get(counted_rows_);
+    in.Get(row_hits_);
+    in.Get(queued_reads_);
+    in.Get(bank_scan_stamps_);
+    in.Get(scan_id_);
+    std::vector<int> ref_q_indices;
+    in.Get(ref_q_indices);
+    ref_q_indices_ = std::unordered_set<int>(ref_q_indices.begin(),
+                                             ref_q_indices.end());
+    in.Get(is_in_ref_);
+    in.Get(queue_idx_);
+    in.Get(clk_);
+    in.Get(rank_q_empty);
 }
 
 Command CommandQueue::GetCommandToIssue() {
@@ -42,6 +99,10 @@ Command CommandQueue::GetCommandToIssue() {
                 continue;
             }
         }
+        // skip queues whose banks can't be ready yet
+        if (QueueReadyCycle(queue_idx_) > clk_) {
+            continue;
+        }
         auto cmd = GetFirstReadyInQueue(queue);
         if (cmd.IsValid()) {
             if (cmd.IsReadWrite()) {
@@ -53,6 +114,42 @@ Command CommandQueue::GetCommandToIssue() {
     return Command();
 }
 
+uint64_t CommandQueue::QueueReadyCycle(int q_idx) const {
+    if (queue_rank_versions_[q_idx] !=
+        channel_state_.RankVersion(queue_ranks_[q_idx])) {
+        UpdateQueueReadyCycle(q_idx);
+    }
+    return queue_ready_cycles_[q_idx];
+}
+
+void CommandQueue::UpdateQueueReadyCycle(int q_idx) const {
+    uint64_t ready_cycle = std::numeric_limits<uint64_t>::max();
+    for (const auto& cmd : queues_[q_idx]) {
+        ready_cycle =
+            std::min(ready_cycle, channel_state_.EarliestReadyCycle(cmd));
+    }
+    queue_ready_cycles_[q_idx] = ready_cycle;
+    queue_rank_versions_[q_idx] =
+        channel_state_.RankVersion(queue_ranks_[q_idx]);
+    return;
+}
+
+uint64_t CommandQueue::EarliestReadyCycle() const {
+    // no command in the queues can be issued before this cycle, note that
+    // precharge arbitration and R/W dependencies can only delay it further
+    uint64_t ready_cycle = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < num_queues_; i++) {
+        if (is_in_ref_ && ref_q_indices_.find(i) != ref_q_indices_.end()) {
+            continue;
+        }
+        ready_cycle = std::min(ready_cycle, QueueReadyCycle(i));
+        if (ready_cycle <= clk_) {
+            return clk_;
+        }
+    }
+    return ready_cycle;
+}
+
 Command CommandQueue::FinishRefresh() {
     // we can do something fancy here like clearing the R/Ws
     // that already had ACT on the way but by doing that we
@@ -74,41 +171,48 @@ Command CommandQueue::FinishRefresh() {
     return cmd;
 }
 
-bool CommandQueue::ArbitratePrecharge(const CMDIterator& cmd_it,
-                                      const CMDQueue& queue) const {
-    auto cmd = *cmd_it;
-
-    for (auto prev_itr = queue.begin(); prev_itr != cmd_it; prev_itr++) {
-        if (prev_itr->Rank() == cmd.Rank() &&
-            prev_itr->Bankgroup() == cmd.Bankgroup() &&
-            prev_itr->Bank() == cmd.Bank()) {
-            return false;
-        }
-    }
-
-    bool pending_row_hits_exist = false;
-    int open_row =
-        channel_state_.OpenRow(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
-    for (auto pending_itr = cmd_it; pending_itr != queue.end(); pending_itr++) {
-        if (pending_itr->Row() == open_row &&
-            pending_itr->Bank() == cmd.Bank() &&
-            pending_itr->Bankgroup() == cmd.Bankgroup() &&
-            pending_itr->Rank() == cmd.Rank()) {
-            pending_row_hits_exist = true;
-            break;
-        }
+bool CommandQueue::ArbitratePrecharge(const Command& cmd,
+                                      bool older_same_bank) const {
+    if (older_same_bank) {
+        return false;
     }
 
+    // no older command to the bank, so every queued command to the bank is
+    // at or after this one
+    bool pending_row_hits_exist = OpenRowHits(cmd) > 0;
     bool rowhit_limit_reached =
         channel_state_.RowHitCount(cmd.Rank(), cmd.Bankgroup(), cmd.Bank()) >=
         4;
     if (!pending_row_hits_exist || rowhit_limit_reached) {
-        simple_stats_.Increment("num_ondemand_pres");
+        simple_stats_.Increment(Counter::NUM_ONDEMAND_PRES);
         return true;
     }
     return false;
 }
 
+int CommandQueue::GetBankIndex(const Command& cmd) const {
+    return cmd.Rank() * config_.banks +
+           cmd.Bankgroup() * config_.banks_per_group + cmd.Bank();
+}
+
+int CommandQueue::OpenRowHits(const Command& cmd) const {
+    int bank = GetBankIndex(cmd);
+    int open_row =
+        channel_state_.OpenRow(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
+    if (counted_rows_[bank] != open_row) {
+        int q_idx = GetQueueIndex(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
+        int hits = 0;
+        for (const auto& queued : queues_[q_idx]) {
+            if (queued.Row() == open_row && GetBankIndex(queued) == bank) {
+                hits++;
+            }
+        }
+        counted_rows_[bank] = open_row;
+        row_hits_[bank] = hits;
+    }
+    return row_hits_[bank];
+}
+
 bool CommandQueue::WillAcceptCommand(int rank, int bankgroup, int bank) const {
     int q_idx = GetQueueIndex(rank, bankgroup, bank);
     return queues_[q_idx].size() < queue_size_;
@@ -129,6 +233,16 @@ bool CommandQueue::AddCommand(Command cmd) {
     if (queue.size() < queue_size_) {
         queue.push_back(cmd);
         rank_q_empty[cmd.Rank()] = false;
+        int q_idx = GetQueueIndex(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
+        int bank = GetBankIndex(cmd);
+        if (cmd.Row() == counted_rows_[bank]) {
+            row_hits_[bank]++;
+        }
+        if (cmd.IsRead()) {
+            queued_reads_[q_idx]++;
+        }
+        queue_ready_cycles_[q_idx] = std::min(
+            queue_ready_cycles_[q_idx], channel_state_.EarliestReadyCycle(cmd));
         return true;
     } else {
         return false;
@@ -176,13 +290,17 @@ CMDQueue& CommandQueue::GetQueue(int rank, int bankgroup, int bank) {
 }
 
 Command CommandQueue::GetFirstReadyInQueue(CMDQueue& queue) const {
+    scan_id_++;
     for (auto cmd_it = queue.begin(); cmd_it != queue.end(); cmd_it++) {
+        int bank = GetBankIndex(*cmd_it);
+        bool older_same_bank = bank_scan_stamps_[bank] == scan_id_;
+        bank_scan_stamps_[bank] = scan_id_;
         Command cmd = channel_state_.GetReadyCommand(*cmd_it, clk_);
         if (!cmd.IsValid()) {
             continue;
         }
         if (cmd.cmd_type == CommandType::PRECHARGE) {
-            if (!ArbitratePrecharge(cmd_it, queue)) {
+            if (!ArbitratePrecharge(*cmd_it, older_same_bank)) {
                 continue;
             }
         } else if (cmd.IsWrite()) {
@@ -199,6 +317,14 @@ void CommandQueue::EraseRWCommand(const Command& cmd) {
     auto& queue = GetQueue(cmd.Rank(), cmd.Bankgroup(), cmd.Bank());
     for (auto cmd_it = queue.begin(); cmd_it != queue.end(); cmd_it++) {
         if (cmd.hex_addr == cmd_it->hex_addr && cmd.cmd_type == cmd_it->cmd_type) {
+            int bank = GetBankIndex(*cmd_it);
+            if (cmd_it->Row() == counted_rows_[bank]) {
+                row_hits_[bank]--;
+            }
+            if (cmd_it->IsRead()) {
+                queued_reads_[GetQueueIndex(cmd.Rank(), cmd.Bankgroup(),
+                                            cmd.Bank())]--;
+            }
             queue.erase(cmd_it);
             return;
         }
@@ -219,6 +345,11 @@ bool CommandQueue::HasRWDependency(const CMDIterator& cmd_it,
                                    const CMDQueue& queue) const {
     // Read after write has been checked in controller so we only
     // check write after read here
+    const auto& cmd = *cmd_it;
+    if (queued_reads_[GetQueueIndex(cmd.Rank(), cmd.Bankgroup(),
+                                    cmd.Bank())] == 0) {
+        return false;
+    }
     for (auto it = queue.begin(); it != cmd_it; it++) {
         if (it->IsRead() && it->Row() == cmd_it->Row() &&
             it->Column() == cmd_it->Column() && it->Bank() == cmd_it->Bank() &&
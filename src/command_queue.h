@@ -4,6 +4,7 @@
 #include <unordered_set>
 #include <vector>
 #include "channel_state.h"
+#include "checkpoint.h"
 #include "common.h"
 #include "configuration.h"
 #include "simple_stats.h"
@@ -21,19 +22,36 @@ class CommandQueue {
     Command GetCommandToIssue();
     Command FinishRefresh();
     void ClockTick() { clk_ += 1; };
+    void FastForward(uint64_t clk) { clk_ = clk; }
+    uint64_t EarliestReadyCycle() const;
     bool WillAcceptCommand(int rank, int bankgroup, int bank) const;
+    bool WillAcceptCommand(int q_idx) const {
+        return queues_[q_idx].size() < queue_size_;
+    }
+    int NumQueues() const { return num_queues_; }
+    int GetQueueIndex(int rank, int bankgroup, int bank) const;
     bool AddCommand(Command cmd);
     bool QueueEmpty() const;
+    bool IsInRefresh() const { return is_in_ref_; }
+    // the waiting refreshes were issued behind our back (functional model)
+    void ResetRefresh() {
+        ref_q_indices_.clear();
+        is_in_ref_ = false;
+    }
     int QueueUsage() const;
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
     std::vector<bool> rank_q_empty;
 
    private:
-    bool ArbitratePrecharge(const CMDIterator& cmd_it,
-                            const CMDQueue& queue) const;
+    bool ArbitratePrecharge(const Command& cmd, bool older_same_bank) const;
     bool HasRWDependency(const CMDIterator& cmd_it,
                          const CMDQueue& queue) const;
+    int GetBankIndex(const Command& cmd) const;
+    int OpenRowHits(const Command& cmd) const;
     Command GetFirstReadyInQueue(CMDQueue& queue) const;
-    int GetQueueIndex(int rank, int bankgroup, int bank) const;
+    uint64_t QueueReadyCycle(int q_idx) const;
+    void UpdateQueueReadyCycle(int q_idx) const;
     CMDQueue& GetQueue(int rank, int bankgroup, int bank);
     CMDQueue& GetNextQueue();
     void GetRefQIndices(const Command& ref);
@@ -47,6 +65,23 @@ class CommandQueue {
 
     std::vector<CMDQueue> queues_;
 
+    // Per queue lower bound of the cycle any of its commands can be ready,
+    // valid as long as the rank version it was computed at hasn't changed
+    std::vector<int> queue_ranks_;
+    mutable std::vector<uint64_t> queue_ready_cycles_;
+    mutable std::vector<uint64_t> queue_rank_versions_;
+
+    // Per bank number of queued commands to counted_rows_, kept up to date
+    // on add and erase and recounted only when the open row of the bank has
+    // moved away from the counted row
+    mutable std::vector<int> counted_rows_;
+    mutable std::vector<int> row_hits_;
+    // number of reads per queue, writes can't depend on an empty set
+    std::vector<int> queued_reads_;
+    // banks seen so far by the current GetFirstReadyInQueue() scan
+    mutable std::vector<uint64_t> bank_scan_stamps_;
+    mutable uint64_t scan_id_;
+
     // Refresh related data structures
     std::unordered_set<int> ref_q_indices_;
     bool is_in_ref_;
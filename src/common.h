@@ -74,9 +74,10 @@ enum class CommandType {
 };
 
 struct Command {
-    Command() : cmd_type(CommandType::SIZE), hex_addr(0) {}
-    Command(CommandType cmd_type, const Address& addr, uint64_t hex_addr)
-        : cmd_type(cmd_type), addr(addr), hex_addr(hex_addr) {}
+    Command() : cmd_type(CommandType::SIZE), hex_addr(0), id(0) {}
+    Command(CommandType cmd_type, const Address& addr, uint64_t hex_addr,
+            uint64_t id = 0)
+        : cmd_type(cmd_type), addr(addr), hex_addr(hex_addr), id(id) {}
     // Command(const Command& cmd) {}
 
     bool IsValid() const { return cmd_type != CommandType::SIZE; }
@@ -101,6 +102,8 @@ struct Command {
     CommandType cmd_type;
     Address addr;
     uint64_t hex_addr;
+    // transaction the command was made for, see Transaction::id
+    uint64_t id;
 
     int Channel() const { return addr.channel; }
     int Rank() const { return addr.rank; }
@@ -115,16 +118,27 @@ struct Command {
 struct Transaction {
     Transaction() {}
     Transaction(uint64_t addr, bool is_write)
-        : addr(addr),
+        : id(0),
+          tag(0),
+          addr(addr),
           added_cycle(0),
           complete_cycle(0),
           is_write(is_write) {}
     Transaction(const Transaction& tran)
-        : addr(tran.addr),
+        : id(tran.id),
+          tag(tran.tag),
+          addr(tran.addr),
+          mapped_addr(tran.mapped_addr),
           added_cycle(tran.added_cycle),
           complete_cycle(tran.complete_cycle),
           is_write(tran.is_write) {}
+    // assigned by the memory system in the order transactions are accepted
+    uint64_t id;
+    // opaque to the simulator, handed back with the completion
+    uint64_t tag;
     uint64_t addr;
+    // addr decoded by the controller when the transaction is added
+    Address mapped_addr;
     uint64_t added_cycle;
     uint64_t complete_cycle;
     bool is_write;
@@ -133,5 +147,15 @@ struct Transaction {
     friend std::istream& operator>>(std::istream& is, Transaction& trans);
 };
 
+// A finished transaction, see MemorySystem::PollCompletions()
+struct Completion {
+    uint64_t id;
+    uint64_t tag;
+    uint64_t addr;
+    uint64_t added_cycle;
+    uint64_t complete_cycle;
+    bool is_write;
+};
+
 }  // namespace dramsim3
 #endif
@@ -1,5 +1,10 @@
 #include "configuration.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
 #include <vector>
 
 #ifdef THERMAL
@@ -27,11 +32,39 @@ Config::Config(std::string config_file, std::string out_dir)
 #ifdef THERMAL
     InitThermalParams();
 #endif  // THERMAL
+    hash = HashConfigFile(config_file);
     delete (reader_);
 }
 
+uint64_t Config::HashConfigFile(const std::string& config_file) {
+    // FNV-1a over the lines with whitespace and comments stripped, so only
+    // an actual change of a setting changes the hash
+    std::ifstream in(config_file);
+    std::string line;
+    bool in_other = false;
+    uint64_t hash = 14695981039346656037ull;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find_first_of(";#"));
+        line.erase(std::remove_if(line.begin(), line.end(), ::isspace),
+                   line.end());
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] == '[') {
+            in_other = line == "[other]";
+        }
+        if (in_other) {
+            continue;
+        }
+        for (char c : line + "\n") {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
 Address Config::AddressMapping(uint64_t hex_addr) const {
-    hex_addr >>= shift_bits;
+    hex_addr = RequestAddress(hex_addr);
     int channel = (hex_addr >> ch_pos) & ch_mask;
     int rank = (hex_addr >> ra_pos) & ra_mask;
     int bg = (hex_addr >> bg_pos) & bg_mask;
@@ -111,6 +144,7 @@ void Config::InitDRAMParams() {
     num_links = GetInteger("hmc", "num_links", 4);
     link_width = GetInteger("hmc", "link_width", 16);
     link_speed = GetInteger("hmc", "link_speed", 15000);  //MHz
+    logic_speed = GetInteger("hmc", "logic_speed", 0);    //MHz
     block_size = GetInteger("hmc", "block_size", 64);
     xbar_queue_depth = GetInteger("hmc", "xbar_queue_depth", 16);
     if (IsHMC()) {
@@ -160,6 +194,19 @@ void Config::InitOtherParams() {
     // 1: default value, adds epoch CSV output on level 0
     // 2: adds histogram outputs in a different CSV format
     output_level = reader.GetInteger("other", "output_level", 1);
+    // event driven mode fast-forwards idle/stalled cycles, the results are
+    // identical to the cycle-by-cycle mode
+    event_driven = reader.GetBoolean("other", "event_driven", false);
+    // channels can be simulated in parallel, they only synchronize (and
+    // deliver callbacks) every sync_quantum cycles, 1 is exactly serial
+    channel_threads = GetInteger("other", "channel_threads", 1);
+    sync_quantum = GetInteger("other", "sync_quantum", 1);
+    pin_threads = reader.GetBoolean("other", "pin_threads", false);
+    if (channel_threads < 1 || sync_quantum < 1) {
+        std::cerr << "channel_threads and sync_quantum must be positive"
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
     // Other Parameters
     // give a prefix instead of specify the output name one by one...
     // this would allow outputing to a directory and you can always override
@@ -220,12 +267,22 @@ void Config::InitSystemParams() {
     channels = GetInteger("system", "channels", 1);
     bus_width = GetInteger("system", "bus_width", 64);
     address_mapping = reader.Get("system", "address_mapping", "chrobabgraco");
+    ch_xor = reader.Get("system", "ch_xor", "");
+    ra_xor = reader.Get("system", "ra_xor", "");
+    bg_xor = reader.Get("system", "bg_xor", "");
+    ba_xor = reader.Get("system", "ba_xor", "");
     queue_structure = reader.Get("system", "queue_structure", "PER_BANK");
     row_buf_policy = reader.Get("system", "row_buf_policy", "OPEN_PAGE");
     cmd_queue_size = GetInteger("system", "cmd_queue_size", 16);
     trans_queue_size = GetInteger("system", "trans_queue_size", 32);
     unified_queue = reader.GetBoolean("system", "unified_queue", false);
     write_buf_size = GetInteger("system", "write_buf_size", 16);
+    ideal_memory = reader.GetBoolean("system", "ideal_memory", false);
+    ideal_memory_bandwidth = GetInteger("system", "ideal_memory_bandwidth", 0);
+    if (ideal_memory_bandwidth < 0) {
+        std::cerr << "ideal_memory_bandwidth can't be negative" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
     std::string ref_policy =
         reader.Get("system", "refresh_policy", "RANK_LEVEL_STAGGERED");
     if (ref_policy == "RANK_LEVEL_SIMULTANEOUS") {
@@ -401,6 +458,69 @@ void Config::SetAddressMapping() {
     ba_mask = (1 << field_widths.at("ba")) - 1;
     ro_mask = (1 << field_widths.at("ro")) - 1;
     co_mask = (1 << field_widths.at("co")) - 1;
+
+    // XOR hashing, field bit i is flipped by the parity of the address bits
+    // in its i-th mask. Only row, column and unmapped bits may be used so the
+    // mapping stays one to one
+    uint64_t hashed_bits = (ch_mask << ch_pos) | (ra_mask << ra_pos) |
+                           (bg_mask << bg_pos) | (ba_mask << ba_pos);
+    std::vector<uint64_t> bit_flips(64, 0);
+    bool use_xor = false;
+    std::vector<std::pair<std::string, const std::string*> > xor_fields = {
+        {"ch", &ch_xor}, {"ra", &ra_xor}, {"bg", &bg_xor}, {"ba", &ba_xor}};
+    for (const auto& field : xor_fields) {
+        std::stringstream masks(*field.second);
+        std::string mask_str;
+        int bit = 0;
+        while (std::getline(masks, mask_str, ',')) {
+            const char* str = mask_str.c_str();
+            char* end = nullptr;
+            errno = 0;
+            uint64_t mask = strtoull(str, &end, 0);
+            while (end != str && isspace(*end)) {
+                end++;
+            }
+            if (end == str || *end != '\0' || errno == ERANGE) {
+                std::cerr << "Invalid XOR mask \"" << mask_str << "\" in "
+                          << field.first << "_xor = " << *field.second
+                          << std::endl;
+                AbruptExit(__FILE__, __LINE__);
+            }
+            if (bit >= field_widths.at(field.first)) {
+                std::cerr << "Too many XOR masks for " << field.first
+                          << std::endl;
+                AbruptExit(__FILE__, __LINE__);
+            }
+            if ((mask & ((1ull << shift_bits) - 1)) ||
+                ((mask >> shift_bits) & hashed_bits)) {
+                std::cerr << "XOR mask " << mask_str << " of " << field.first
+                          << " can only use row, column or unmapped bits"
+                          << std::endl;
+                AbruptExit(__FILE__, __LINE__);
+            }
+            uint64_t target = 1ull << (field_pos.at(field.first) + bit);
+            mask >>= shift_bits;
+            for (int i = 0; i < 64; i++) {
+                if ((mask >> i) & 1) {
+                    bit_flips[i] |= target;
+                }
+            }
+            use_xor = true;
+            bit++;
+        }
+    }
+    if (use_xor) {
+        xor_table.assign(8 * 256, 0);
+        for (int i = 0; i < 8; i++) {
+            for (int v = 0; v < 256; v++) {
+                for (int b = 0; b < 8; b++) {
+                    if ((v >> b) & 1) {
+                        xor_table[i * 256 + v] ^= bit_flips[i * 8 + b];
+                    }
+                }
+            }
+        }
+    }
 }
 
 }  // namespace dramsim3
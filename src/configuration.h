@@ -3,6 +3,7 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 #include "common.h"
 
 #include "INIReader.h"
@@ -35,6 +36,18 @@ class Config {
    public:
     Config(std::string config_file, std::string out_dir);
     Address AddressMapping(uint64_t hex_addr) const;
+    // hex_addr in units of requests, with the XOR hashing applied
+    uint64_t RequestAddress(uint64_t hex_addr) const {
+        hex_addr >>= shift_bits;
+        if (!xor_table.empty()) {
+            uint64_t hash = 0;
+            for (int i = 0; i < 8; i++) {
+                hash ^= xor_table[i * 256 + ((hex_addr >> (i * 8)) & 0xff)];
+            }
+            hex_addr ^= hash;
+        }
+        return hex_addr;
+    }
     // DRAM physical structure
     DRAMProtocol protocol;
     int channel_size;
@@ -54,6 +67,10 @@ class Config {
     int shift_bits;
     int ch_pos, ra_pos, bg_pos, ba_pos, ro_pos, co_pos;
     uint64_t ch_mask, ra_mask, bg_mask, ba_mask, ro_mask, co_mask;
+    // XOR hashing as a GF(2) bit matrix split into 8 byte wide tables, entry
+    // [i][v] is what byte i of the request address having value v flips in
+    // the ch/ra/bg/ba bits, empty when no hashing is configured
+    std::vector<uint64_t> xor_table;
 
     // Generic DRAM timing parameters
     double tCK;
@@ -116,12 +133,16 @@ class Config {
     int num_dies;
     int link_width;
     int link_speed;
+    int logic_speed;  // MHz, 0 to derive it from the link speed
     int num_vaults;
     int block_size;  // block size in bytes
     int xbar_queue_depth;
 
     // System
     std::string address_mapping;
+    // per field comma separated masks of physical address bits that are
+    // XORed into each field bit, lowest bit first
+    std::string ch_xor, ra_xor, bg_xor, ba_xor;
     std::string queue_structure;
     std::string row_buf_policy;
     RefreshPolicy refresh_policy;
@@ -137,6 +158,13 @@ class Config {
 
     int epoch_period;
     int output_level;
+    // skip cycles where nothing can happen instead of ticking through them
+    bool event_driven;
+    // tick channels on this many threads, synchronizing every sync_quantum
+    int channel_threads;
+    int sync_quantum;
+    // pin the channel threads to the CPUs the process may run on
+    bool pin_threads;
     std::string output_dir;
     std::string output_prefix;
     std::string json_stats_name;
@@ -159,7 +187,15 @@ class Config {
     // yzy: add another function
     bool IsDDR4() const { return (protocol == DRAMProtocol::DDR4); }
 
+    // fixed latency memory instead of the DRAM model, accepting at most
+    // ideal_memory_bandwidth requests per cycle (0 for no limit)
+    bool ideal_memory;
     int ideal_memory_latency;
+    int ideal_memory_bandwidth;
+
+    // hash of the config file without its [other] section, i.e. of whatever
+    // decides the simulated state, checkpoints only restore across equal ones
+    uint64_t hash;
 
 #ifdef THERMAL
     std::string loc_mapping;
@@ -197,6 +233,7 @@ class Config {
 #endif  // THERMAL
     void InitTimingParams();
     void SetAddressMapping();
+    static uint64_t HashConfigFile(const std::string& config_file);
 };
 
 }  // namespace dramsim3
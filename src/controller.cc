@@ -23,18 +23,20 @@ Controller::Controller(int channel, const Config &config, const Timing &timing)
       thermal_calc_(thermal_calc),
 #endif  // THERMAL
       is_unified_queue_(config.unified_queue),
+      unified_queue_(cmd_queue_.NumQueues(),
+                     is_unified_queue_ ? config.trans_queue_size : 0),
+      read_queue_(cmd_queue_.NumQueues(),
+                  is_unified_queue_ ? 0 : config.trans_queue_size),
+      write_buffer_(cmd_queue_.NumQueues(),
+                    is_unified_queue_ ? 0 : config.trans_queue_size),
+      pending_rd_q_(config.trans_queue_size),
+      pending_wr_q_(config.trans_queue_size),
+      return_seq_(0),
       row_buf_policy_(config.row_buf_policy == "CLOSE_PAGE"
                           ? RowBufPolicy::CLOSE_PAGE
                           : RowBufPolicy::OPEN_PAGE),
       last_trans_clk_(0),
       write_draining_(0) {
-    if (is_unified_queue_) {
-        unified_queue_.reserve(config_.trans_queue_size);
-    } else {
-        read_queue_.reserve(config_.trans_queue_size);
-        write_buffer_.reserve(config_.trans_queue_size);
-    }
-
 #ifdef CMD_TRACE
     std::string trace_file_name = config_.output_prefix + "ch_" +
                                   std::to_string(channel_id_) + "cmd.trace";
@@ -43,25 +45,102 @@ Controller::Controller(int channel, const Config &config, const Timing &timing)
 #endif  // CMD_TRACE
 }
 
-std::pair<uint64_t, int> Controller::ReturnDoneTrans(uint64_t clk) {
-    auto it = return_queue_.begin();
-    while (it != return_queue_.end()) {
-        if (clk >= it->complete_cycle) {
-            Logger::PrintReturn(clk, *it);
-            if (it->is_write) {
-                simple_stats_.Increment("num_writes_done");
-            } else {
-                simple_stats_.Increment("num_reads_done");
-                simple_stats_.AddValue("read_latency", clk_ - it->added_cycle);
-            }
-            auto pair = std::make_pair(it->addr, it->is_write);
-            it = return_queue_.erase(it);
-            return pair;
-        } else {
-            ++it;
-        }
+void Controller::ReturnAllDoneTrans(uint64_t clk,
+                                    std::vector<Transaction> &done) {
+    while (!return_queue_.empty() &&
+           return_queue_.top().trans.complete_cycle <= clk) {
+        const Transaction &trans = return_queue_.top().trans;
+        Logger::PrintReturn(clk, trans);
+        RecordReturn(trans);
+        done.push_back(trans);
+        return_queue_.pop();
+    }
+}
+
+void Controller::FunctionalForward(uint64_t clk) {
+    if (clk <= clk_) {
+        return;
+    }
+    refresh_.FunctionalForward(clk);
+    if (channel_state_.IsRefreshWaiting()) {
+        channel_state_.FunctionalRefresh();
+        cmd_queue_.ResetRefresh();
+    }
+    cmd_queue_.FastForward(clk);
+    clk_ = clk;
+    return;
+}
+
+void Controller::FunctionalAccess(uint64_t hex_addr, bool is_write) {
+    Transaction trans(hex_addr, is_write);
+    trans.mapped_addr = config_.AddressMapping(hex_addr);
+    channel_state_.FunctionalUpdate(TransToCommand(trans));
+    last_trans_clk_ = clk_;
+    return;
+}
+
+void Controller::Checkpoint(CheckpointWriter &out) const {
+    out.Put(clk_);
+    simple_stats_.Checkpoint(out);
+    channel_state_.Checkpoint(out);
+    cmd_queue_.Checkpoint(out);
+    refresh_.Checkpoint(out);
+    unified_queue_.Checkpoint(out);
+    read_queue_.Checkpoint(out);
+    write_buffer_.Checkpoint(out);
+    pending_rd_q_.Checkpoint(out);
+    pending_wr_q_.Checkpoint(out);
+
+    // the heap can only be walked by taking it apart
+    auto return_queue = return_queue_;
+    out.Put(static_cast<uint64_t>(return_queue.size()));
+    while (!return_queue.empty()) {
+        out.Put(return_queue.top().trans);
+        out.Put(return_queue.top().seq);
+        return_queue.pop();
+    }
+    out.Put(return_seq_);
+    out.Put(last_trans_clk_);
+    out.Put(write_draining_);
+}
+
+void Controller::Restore(CheckpointReader &in) {
+    in.Get(clk_);
+    simple_stats_.Restore(in);
+    channel_state_.Restore(in);
+    cmd_queue_.Restore(in);
+    refresh_.Restore(in);
+    unified_queue_.Restore(in);
+    read_queue_.Restore(in);
+    write_buffer_.Restore(in);
+    pending_rd_q_.Restore(in);
+    pending_wr_q_.Restore(in);
+
+    size_t num_returns = in.GetSize();
+    for (size_t i = 0; i < num_returns; i++) {
+        Transaction trans;
+        uint64_t seq;
+        in.Get(trans);
+        in.Get(seq);
+        return_queue_.emplace(trans, seq);
+    }
+    in.Get(return_seq_);
+    in.Get(last_trans_clk_);
+    in.Get(write_draining_);
+}
+
+void Controller::QueueReturn(const Transaction &trans) {
+    return_queue_.emplace(trans, return_seq_++);
+}
+
+void Controller::RecordReturn(const Transaction &trans) {
+    if (trans.is_write) {
+        simple_stats_.Increment(Counter::NUM_WRITES_DONE);
+    } else {
+        simple_stats_.Increment(Counter::NUM_READS_DONE);
+        simple_stats_.AddValue(Histogram::READ_LATENCY,
+                               clk_ - trans.added_cycle);
     }
-    return std::make_pair(-1, -1);
 }
 
 void Controller::ClockTick() {
@@ -91,7 +170,7 @@ void Controller::ClockTick() {
             if (second_cmd.IsValid()) {
                 if (second_cmd.IsReadWrite() != cmd.IsReadWrite()) {
                     IssueCommand(second_cmd);
-                    simple_stats_.Increment("hbm_dual_cmds");
+                    simple_stats_.Increment(Counter::HBM_DUAL_CMDS);
                 }
             }
         }
@@ -100,14 +179,16 @@ void Controller::ClockTick() {
     // power updates pt 1
     for (int i = 0; i < config_.ranks; i++) {
         if (channel_state_.IsRankSelfRefreshing(i)) {
-            simple_stats_.IncrementVec("sref_cycles", i);
+            simple_stats_.IncrementVec(VecCounter::SREF_CYCLES, i);
         } else {
             bool all_idle = channel_state_.IsAllBankIdleInRank(i);
             if (all_idle) {
-                simple_stats_.IncrementVec("all_bank_idle_cycles", i);
+                simple_stats_.IncrementVec(VecCounter::ALL_BANK_IDLE_CYCLES,
+                                           i);
                 channel_state_.rank_idle_cycles[i] += 1;
             } else {
-                simple_stats_.IncrementVec("rank_active_cycles", i);
+                simple_stats_.IncrementVec(VecCounter::RANK_ACTIVE_CYCLES,
+                                           i);
                 // reset
                 channel_state_.rank_idle_cycles[i] = 0;
             }
@@ -149,50 +230,139 @@ void Controller::ClockTick() {
     ScheduleTransaction();
     clk_++;
     cmd_queue_.ClockTick();
-    simple_stats_.Increment("num_cycles");
+    simple_stats_.Increment(Counter::NUM_CYCLES);
+    return;
+}
+
+uint64_t Controller::NextEventCycle() const {
+    if (IsTransactionSchedulable()) {
+        return clk_;
+    }
+
+    uint64_t next_cycle = refresh_.NextRefreshCycle();
+    if (channel_state_.IsRefreshWaiting()) {
+        // the refresh queues are picked on the first FinishRefresh() call
+        if (!cmd_queue_.IsInRefresh()) {
+            return clk_;
+        }
+        const auto &ref = channel_state_.PendingRefCommand();
+        next_cycle =
+            std::min(next_cycle, channel_state_.EarliestReadyCycle(ref));
+    }
+    if (!return_queue_.empty()) {
+        next_cycle =
+            std::min(next_cycle, return_queue_.top().trans.complete_cycle);
+    }
+
+    if (config_.enable_self_refresh) {
+        for (int i = 0; i < config_.ranks; i++) {
+            if (channel_state_.IsRankSelfRefreshing(i)) {
+                if (!cmd_queue_.rank_q_empty[i]) {
+                    return clk_;
+                }
+            } else if (cmd_queue_.rank_q_empty[i] &&
+                       channel_state_.IsAllBankIdleInRank(i)) {
+                // idle cycles are counted before the threshold is checked
+                uint64_t idle_cycles = channel_state_.rank_idle_cycles[i] + 1;
+                uint64_t threshold = config_.sref_threshold;
+                if (idle_cycles >= threshold) {
+                    return clk_;
+                }
+                next_cycle =
+                    std::min(next_cycle, clk_ + threshold - idle_cycles);
+            }
+        }
+    }
+
+    if (next_cycle > clk_) {
+        next_cycle = std::min(next_cycle, cmd_queue_.EarliestReadyCycle());
+    }
+    return std::max(next_cycle, clk_);
+}
+
+void Controller::FastForward(uint64_t clk) {
+    if (clk <= clk_) {
+        return;
+    }
+    // nothing is issued or scheduled in between so the power states of the
+    // ranks stay the same, this is what ClockTick() would have counted
+    uint64_t cycles = clk - clk_;
+    for (int i = 0; i < config_.ranks; i++) {
+        if (channel_state_.IsRankSelfRefreshing(i)) {
+            simple_stats_.IncrementVecBy(VecCounter::SREF_CYCLES, i,
+                                         cycles);
+        } else if (channel_state_.IsAllBankIdleInRank(i)) {
+            simple_stats_.IncrementVecBy(VecCounter::ALL_BANK_IDLE_CYCLES, i,
+                                         cycles);
+            channel_state_.rank_idle_cycles[i] += cycles;
+        } else {
+            simple_stats_.IncrementVecBy(VecCounter::RANK_ACTIVE_CYCLES, i,
+                                         cycles);
+            channel_state_.rank_idle_cycles[i] = 0;
+        }
+    }
+    simple_stats_.IncrementBy(Counter::NUM_CYCLES, cycles);
+    refresh_.FastForward(clk);
+    cmd_queue_.FastForward(clk);
+    clk_ = clk;
     return;
 }
 
 bool Controller::WillAcceptTransaction(uint64_t hex_addr, bool is_write) const {
     if (is_unified_queue_) {
-        return unified_queue_.size() < unified_queue_.capacity();
+        return unified_queue_.Size() < unified_queue_.Capacity();
     } else if (!is_write) {
-        return read_queue_.size() < read_queue_.capacity();
+        return read_queue_.Size() < read_queue_.Capacity();
     } else {
-        return write_buffer_.size() < write_buffer_.capacity();
+        return write_buffer_.Size() < write_buffer_.Capacity();
     }
 }
 
+int Controller::TransQueueVacancy(bool is_write) const {
+    const TransactionQueue &queue =
+        is_unified_queue_ ? unified_queue_
+                          : is_write ? write_buffer_ : read_queue_;
+    return static_cast<int>(queue.Capacity() - queue.Size());
+}
+
 bool Controller::AddTransaction(Transaction trans) {
     trans.added_cycle = clk_;
-    simple_stats_.AddValue("interarrival_latency", clk_ - last_trans_clk_);
+    trans.mapped_addr = config_.AddressMapping(trans.addr);
+    int bucket = cmd_queue_.GetQueueIndex(trans.mapped_addr.rank,
+                                          trans.mapped_addr.bankgroup,
+                                          trans.mapped_addr.bank);
+    simple_stats_.AddValue(Histogram::INTERARRIVAL_LATENCY,
+                           clk_ - last_trans_clk_);
     last_trans_clk_ = clk_;
 
     if (trans.is_write) {
-        if (pending_wr_q_.count(trans.addr) == 0) {  // can not merge writes
-            pending_wr_q_.insert(std::make_pair(trans.addr, trans));
+        if (!pending_wr_q_.Contains(trans.addr)) {  // can not merge writes
+            pending_wr_q_.Insert(trans);
             if (is_unified_queue_) {
-                unified_queue_.push_back(trans);
+                unified_queue_.Push(bucket, trans);
             } else {
-                write_buffer_.push_back(trans);
+                write_buffer_.Push(bucket, trans);
             }
+        } else {
+            // merged into the pending write, done as far as the caller is
+            // concerned
+            trans.complete_cycle = clk_ + 1;
+            QueueReturn(trans);
         }
-        // trans.complete_cycle = clk_ + 1;
-        // return_queue_.push_back(trans);
         return true;
     } else {  // read
         // if in write buffer, use the write buffer value
-        if (pending_wr_q_.count(trans.addr) > 0) {
+        if (pending_wr_q_.Contains(trans.addr)) {
             trans.complete_cycle = clk_ + 1;
-            return_queue_.push_back(trans);
+            QueueReturn(trans);
             return true;
         }
-        pending_rd_q_.insert(std::make_pair(trans.addr, trans));
-        if (pending_rd_q_.count(trans.addr) == 1) {
+        pending_rd_q_.Insert(trans);
+        if (pending_rd_q_.Count(trans.addr) == 1) {
             if (is_unified_queue_) {
-                unified_queue_.push_back(trans);
+                unified_queue_.Push(bucket, trans);
             } else {
-                read_queue_.push_back(trans);
+                read_queue_.Push(bucket, trans);
             }
         }
         return true;
@@ -204,32 +374,58 @@ void Controller::ScheduleTransaction() {
     // determine whether to schedule read or write
     if (write_draining_ == 0 && !is_unified_queue_) {
         // we basically have a upper and lower threshold for write buffer
-        if ((write_buffer_.size() >= write_buffer_.capacity()) ||
-            (write_buffer_.size() >= 8 || cmd_queue_.QueueEmpty())) {
-            write_draining_ = write_buffer_.size();
+        if ((write_buffer_.Size() >= write_buffer_.Capacity()) ||
+            (write_buffer_.Size() >= 8 || cmd_queue_.QueueEmpty())) {
+            write_draining_ = write_buffer_.Size();
         }
     }
 
-    std::vector<Transaction> &queue =
+    TransactionQueue &queue =
         is_unified_queue_ ? unified_queue_
                           : write_draining_ > 0 ? write_buffer_ : read_queue_;
-    for (auto it = queue.begin(); it != queue.end(); it++) {
-        auto cmd = TransToCommand(*it);
-        if (cmd_queue_.WillAcceptCommand(cmd.Rank(), cmd.Bankgroup(),
-                                         cmd.Bank())) {
-            if (!is_unified_queue_ && cmd.IsWrite()) {
-                // Enforce R->W dependency
-                if (pending_rd_q_.count(it->addr) > 0) {
-                    write_draining_ = 0;
-                    break;
-                }
-                write_draining_ -= 1;
+    // oldest transaction that fits into its command queue
+    int bucket = queue.OldestSchedulableBucket(cmd_queue_);
+    if (bucket < 0) {
+        return;
+    }
+    auto cmd = TransToCommand(queue.Front(bucket));
+    if (!is_unified_queue_ && cmd.IsWrite()) {
+        // Enforce R->W dependency
+        if (pending_rd_q_.Contains(cmd.hex_addr)) {
+            write_draining_ = 0;
+            // the read may not be scheduled yet, let the reads go this cycle
+            // or the next drain waits on it again and neither ever goes
+            bucket = read_queue_.OldestSchedulableBucket(cmd_queue_);
+            if (bucket >= 0) {
+                cmd = TransToCommand(read_queue_.Front(bucket));
+                cmd_queue_.AddCommand(cmd);
+                read_queue_.Pop(bucket);
             }
-            cmd_queue_.AddCommand(cmd);
-            queue.erase(it);
-            break;
+            return;
         }
+        write_draining_ -= 1;
     }
+    cmd_queue_.AddCommand(cmd);
+    queue.Pop(bucket);
+}
+
+bool Controller::IsTransactionSchedulable() const {
+    // whether ScheduleTransaction() would change anything this cycle
+    int write_draining = write_draining_;
+    if (write_draining == 0 && !is_unified_queue_) {
+        if ((write_buffer_.Size() >= write_buffer_.Capacity()) ||
+            (write_buffer_.Size() >= 8 || cmd_queue_.QueueEmpty())) {
+            write_draining = write_buffer_.Size();
+        }
+    }
+    if (write_draining != write_draining_) {
+        return true;
+    }
+
+    const TransactionQueue &queue =
+        is_unified_queue_ ? unified_queue_
+                          : write_draining > 0 ? write_buffer_ : read_queue_;
+    return queue.OldestSchedulableBucket(cmd_queue_) >= 0;
 }
 
 void Controller::IssueCommand(const Command &cmd) {
@@ -247,40 +443,35 @@ void Controller::IssueCommand(const Command &cmd) {
 #endif  // THERMAL
     // if read/write, update pending queue and return queue
     if (cmd.IsRead()) {
-        auto num_reads = pending_rd_q_.count(cmd.hex_addr);
-        if (num_reads == 0) {
+        Transaction trans;
+        if (!pending_rd_q_.PopFront(cmd.hex_addr, trans)) {
             std::cerr << cmd.hex_addr << " not in read queue! " << std::endl;
             exit(1);
         }
         // if there are multiple reads pending return them all
-        while (num_reads > 0) {
-            auto it = pending_rd_q_.find(cmd.hex_addr);
-            it->second.complete_cycle = clk_ + config_.read_delay;
-            return_queue_.push_back(it->second);
-            pending_rd_q_.erase(it);
-            num_reads -= 1;
-        }
+        do {
+            trans.complete_cycle = clk_ + config_.read_delay;
+            QueueReturn(trans);
+        } while (pending_rd_q_.PopFront(cmd.hex_addr, trans));
     } else if (cmd.IsWrite()) {
         // there should be only 1 write to the same location at a time
-        auto it = pending_wr_q_.find(cmd.hex_addr);
-        if (it == pending_wr_q_.end()) {
+        Transaction trans;
+        if (!pending_wr_q_.PopFront(cmd.hex_addr, trans)) {
             std::cerr << cmd.hex_addr << " not in write queue!" << std::endl;
             exit(1);
         }
-        auto wr_lat = clk_ - it->second.added_cycle + config_.write_delay;
-        simple_stats_.AddValue("write_latency", wr_lat);
+        auto wr_lat = clk_ - trans.added_cycle + config_.write_delay;
+        simple_stats_.AddValue(Histogram::WRITE_LATENCY, wr_lat);
 
-        it->second.complete_cycle = clk_ + config_.write_delay;
-        return_queue_.push_back(it->second);
-        pending_wr_q_.erase(it);
+        trans.complete_cycle = clk_ + config_.write_delay;
+        QueueReturn(trans);
     }
     // must update stats before states (for row hits)
     UpdateCommandStats(cmd);
     channel_state_.UpdateTimingAndStates(cmd, clk_);
 }
 
-Command Controller::TransToCommand(const Transaction &trans) {
-    auto addr = config_.AddressMapping(trans.addr);
+Command Controller::TransToCommand(const Transaction &trans) const {
     CommandType cmd_type;
     if (row_buf_policy_ == RowBufPolicy::OPEN_PAGE) {
         cmd_type = trans.is_write ? CommandType::WRITE : CommandType::READ;
@@ -288,13 +479,13 @@ Command Controller::TransToCommand(const Transaction &trans) {
         cmd_type = trans.is_write ? CommandType::WRITE_PRECHARGE
                                   : CommandType::READ_PRECHARGE;
     }
-    return Command(cmd_type, addr, trans.addr);
+    return Command(cmd_type, trans.mapped_addr, trans.addr, trans.id);
 }
 
 int Controller::QueueUsage() const { return cmd_queue_.QueueUsage(); }
 
 void Controller::PrintEpochStats() {
-    simple_stats_.Increment("epoch_num");
+    simple_stats_.Increment(Counter::EPOCH_NUM);
     simple_stats_.PrintEpochStats();
 #ifdef THERMAL
     for (int r = 0; r < config_.ranks; r++) {
@@ -321,37 +512,37 @@ void Controller::UpdateCommandStats(const Command &cmd) {
     switch (cmd.cmd_type) {
         case CommandType::READ:
         case CommandType::READ_PRECHARGE:
-            simple_stats_.Increment("num_read_cmds");
+            simple_stats_.Increment(Counter::NUM_READ_CMDS);
             if (channel_state_.RowHitCount(cmd.Rank(), cmd.Bankgroup(),
                                            cmd.Bank()) != 0) {
-                simple_stats_.Increment("num_read_row_hits");
+                simple_stats_.Increment(Counter::NUM_READ_ROW_HITS);
             }
             break;
         case CommandType::WRITE:
         case CommandType::WRITE_PRECHARGE:
-            simple_stats_.Increment("num_write_cmds");
+            simple_stats_.Increment(Counter::NUM_WRITE_CMDS);
             if (channel_state_.RowHitCount(cmd.Rank(), cmd.Bankgroup(),
                                            cmd.Bank()) != 0) {
-                simple_stats_.Increment("num_write_row_hits");
+                simple_stats_.Increment(Counter::NUM_WRITE_ROW_HITS);
             }
             break;
         case CommandType::ACTIVATE:
-            simple_stats_.Increment("num_act_cmds");
+            simple_stats_.Increment(Counter::NUM_ACT_CMDS);
             break;
         case CommandType::PRECHARGE:
-            simple_stats_.Increment("num_pre_cmds");
+            simple_stats_.Increment(Counter::NUM_PRE_CMDS);
             break;
         case CommandType::REFRESH:
-            simple_stats_.Increment("num_ref_cmds");
+            simple_stats_.Increment(Counter::NUM_REF_CMDS);
             break;
         case CommandType::REFRESH_BANK:
-            simple_stats_.Increment("num_refb_cmds");
+            simple_stats_.Increment(Counter::NUM_REFB_CMDS);
             break;
         case CommandType::SREF_ENTER:
-            simple_stats_.Increment("num_srefe_cmds");
+            simple_stats_.Increment(Counter::NUM_SREFE_CMDS);
             break;
         case CommandType::SREF_EXIT:
-            simple_stats_.Increment("num_srefx_cmds");
+            simple_stats_.Increment(Counter::NUM_SREFX_CMDS);
             break;
         default:
             AbruptExit(__FILE__, __LINE__);
@@ -2,14 +2,16 @@
 #define __CONTROLLER_H
 
 #include <fstream>
-#include <map>
+#include <queue>
 #include <unordered_set>
 #include <vector>
 #include "channel_state.h"
 #include "command_queue.h"
 #include "common.h"
+#include "pending_index.h"
 #include "refresh.h"
 #include "simple_stats.h"
+#include "transaction_queue.h"
 
 #ifdef THERMAL
 #include "thermal.h"
@@ -28,14 +30,32 @@ class Controller {
     Controller(int channel, const Config &config, const Timing &timing);
 #endif  // THERMAL
     void ClockTick();
+    // Earliest cycle at which ClockTick() may do more than idle bookkeeping
+    uint64_t NextEventCycle() const;
+    // Account for the idle cycles in [clk_, clk) without ticking them
+    void FastForward(uint64_t clk);
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const;
+    int TransQueueVacancy(bool is_write) const;
     bool AddTransaction(Transaction trans);
     int QueueUsage() const;
+    // transactions added and not returned yet
+    uint64_t Outstanding() const {
+        return pending_rd_q_.Size() + pending_wr_q_.Size() +
+               return_queue_.size();
+    }
     // Stats output
     void PrintEpochStats();
     void PrintFinalStats();
     void ResetStats() { simple_stats_.Reset(); }
-    std::pair<uint64_t, int> ReturnDoneTrans(uint64_t clock);
+    // Append every transaction due by clock to done, in completion order
+    void ReturnAllDoneTrans(uint64_t clock, std::vector<Transaction>& done);
+    // Functional model for sampled simulation, see
+    // BaseDRAMSystem::FunctionalAccess()
+    void FunctionalForward(uint64_t clk);
+    void FunctionalAccess(uint64_t hex_addr, bool is_write);
+    // Restore() expects a freshly constructed controller
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
 
     int channel_id_;
 
@@ -53,16 +73,33 @@ class Controller {
 
     // queue that takes transactions from CPU side
     bool is_unified_queue_;
-    std::vector<Transaction> unified_queue_;
-    std::vector<Transaction> read_queue_;
-    std::vector<Transaction> write_buffer_;
+    TransactionQueue unified_queue_;
+    TransactionQueue read_queue_;
+    TransactionQueue write_buffer_;
 
-    // transactions that are not completed, use map for convenience
-    std::multimap<uint64_t, Transaction> pending_rd_q_;
-    std::multimap<uint64_t, Transaction> pending_wr_q_;
+    // transactions that are not completed, indexed by address
+    PendingIndex pending_rd_q_;
+    PendingIndex pending_wr_q_;
 
-    // completed transactions
-    std::vector<Transaction> return_queue_;
+    // completed transactions, a min-heap on complete_cycle with ties going
+    // to the transaction that was queued first
+    struct ReturnEntry {
+        ReturnEntry(const Transaction& trans, uint64_t seq)
+            : trans(trans), seq(seq) {}
+        Transaction trans;
+        uint64_t seq;
+        bool operator>(const ReturnEntry& other) const {
+            return trans.complete_cycle != other.trans.complete_cycle
+                       ? trans.complete_cycle > other.trans.complete_cycle
+                       : seq > other.seq;
+        }
+    };
+    std::priority_queue<ReturnEntry, std::vector<ReturnEntry>,
+                        std::greater<ReturnEntry> >
+        return_queue_;
+    uint64_t return_seq_;
+    void QueueReturn(const Transaction& trans);
+    void RecordReturn(const Transaction& trans);
 
     // row buffer policy
     RowBufPolicy row_buf_policy_;
@@ -77,8 +114,9 @@ class Controller {
     // transaction queueing
     int write_draining_;
     void ScheduleTransaction();
+    bool IsTransactionSchedulable() const;
     void IssueCommand(const Command &tmp_cmd);
-    Command TransToCommand(const Transaction &trans);
+    Command TransToCommand(const Transaction &trans) const;
     void UpdateCommandStats(const Command &cmd);
 };
 }  // namespace dramsim3
@@ -63,8 +63,7 @@ TraceBasedCPU::TraceBasedCPU(const std::string& config_file,
                              const std::string& output_dir,
                              const std::string& trace_file)
     : CPU(config_file, output_dir) {
-    trace_file_.open(trace_file);
-    if (trace_file_.fail()) {
+    if (!trace_.Open(trace_file)) {
         std::cerr << "Trace file does not exist" << std::endl;
         AbruptExit(__FILE__, __LINE__);
     }
@@ -72,17 +71,17 @@ TraceBasedCPU::TraceBasedCPU(const std::string& config_file,
 
 void TraceBasedCPU::ClockTick() {
     memory_system_.ClockTick();
-    if (!trace_file_.eof()) {
-        if (get_next_) {
-            get_next_ = false;
-            trace_file_ >> trans_;
-        }
-        if (trans_.added_cycle <= clk_) {
-            get_next_ = memory_system_.WillAcceptTransaction(trans_.addr,
-                                                             trans_.is_write);
-            if (get_next_) {
-                memory_system_.AddTransaction(trans_.addr, trans_.is_write);
-            }
+    if (buffer_pos_ == buffer_.size() && !trace_end_) {
+        buffer_.clear();
+        buffer_pos_ = 0;
+        trace_end_ = trace_.Read(buffer_, kCodecBlockSize) == 0;
+    }
+    if (buffer_pos_ < buffer_.size()) {
+        const Transaction& trans = buffer_[buffer_pos_];
+        if (trans.added_cycle <= clk_ &&
+            memory_system_.WillAcceptTransaction(trans.addr, trans.is_write)) {
+            memory_system_.AddTransaction(trans.addr, trans.is_write);
+            buffer_pos_++;
         }
     }
     clk_++;
@@ -5,7 +5,9 @@
 #include <functional>
 #include <random>
 #include <string>
+#include <vector>
 #include "memory_system.h"
+#include "trace_file.h"
 
 namespace dramsim3 {
 
@@ -58,13 +60,14 @@ class TraceBasedCPU : public CPU {
    public:
     TraceBasedCPU(const std::string& config_file, const std::string& output_dir,
                   const std::string& trace_file);
-    ~TraceBasedCPU() { trace_file_.close(); }
     void ClockTick() override;
 
    private:
-    std::ifstream trace_file_;
-    Transaction trans_;
-    bool get_next_ = true;
+    // text, binary or compressed, read a codec block at a time
+    TraceReader trace_;
+    std::vector<Transaction> buffer_;
+    size_t buffer_pos_ = 0;
+    bool trace_end_ = false;
 };
 
 }  // namespace dramsim3
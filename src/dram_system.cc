@@ -1,6 +1,8 @@
 #include "dram_system.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <limits>
 
 namespace dramsim3 {
 
@@ -14,12 +16,14 @@ BaseDRAMSystem::BaseDRAMSystem(Config &config, const std::string &output_dir,
     : read_callback_(read_callback),
       write_callback_(write_callback),
       last_req_clk_(0),
+      next_trans_id_(0),
       config_(config),
       timing_(config_),
 #ifdef THERMAL
       thermal_calc_(config_),
 #endif  // THERMAL
-      clk_(0) {
+      clk_(0),
+      poll_completions_(false) {
     total_channels_ += config_.channels;
 
 #ifdef ADDR_TRACE
@@ -29,11 +33,134 @@ BaseDRAMSystem::BaseDRAMSystem(Config &config, const std::string &output_dir,
 }
 
 int BaseDRAMSystem::GetChannel(uint64_t hex_addr) const {
-    hex_addr >>= config_.shift_bits;
+    hex_addr = config_.RequestAddress(hex_addr);
     return (hex_addr >> config_.ch_pos) & config_.ch_mask;
 }
 
+void BaseDRAMSystem::SyncControllers() {
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        ctrls_[i]->FastForward(clk_);
+    }
+}
+
+uint64_t BaseDRAMSystem::NextEventCycle() const {
+    uint64_t next_cycle = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        next_cycle = std::min(next_cycle, ctrls_[i]->NextEventCycle());
+        if (next_cycle <= clk_) {
+            break;
+        }
+    }
+    return next_cycle;
+}
+
+size_t BaseDRAMSystem::AddTransactions(const Transaction *trans, size_t count,
+                                       std::vector<int> &accepted) {
+    accepted.assign(config_.channels, 0);
+    refused_.assign(config_.channels, false);
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        int channel = GetChannel(trans[i].addr);
+        if (refused_[channel]) {
+            continue;
+        }
+        if (!WillAcceptTransaction(trans[i].addr, trans[i].is_write)) {
+            refused_[channel] = true;
+            continue;
+        }
+        AddTransaction(trans[i].addr, trans[i].is_write, trans[i].tag);
+        accepted[channel]++;
+        total++;
+    }
+    return total;
+}
+
+void BaseDRAMSystem::RunUntil(uint64_t clk) {
+    while (clk_ < clk) {
+        ClockTick();
+    }
+}
+
+void BaseDRAMSystem::Drain() {
+    while (Outstanding() > 0) {
+        ClockTick();
+    }
+}
+
+void BaseDRAMSystem::FunctionalAccess(uint64_t hex_addr, bool is_write) {
+    std::cerr << "No functional model for this memory system" << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+}
+
+void BaseDRAMSystem::FunctionalAdvance(uint64_t cycles) {
+    std::cerr << "No functional model for this memory system" << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+}
+
+void BaseDRAMSystem::EnableCompletionQueue(size_t capacity) {
+    poll_completions_ = true;
+    completions_.Reserve(capacity);
+}
+
+size_t BaseDRAMSystem::PollCompletions(Completion *completions,
+                                       size_t max_count) {
+    size_t count = std::min(max_count, completions_.Size());
+    for (size_t i = 0; i < count; i++) {
+        completions[i] = completions_.Front();
+        completions_.Pop();
+    }
+    return count;
+}
+
+void BaseDRAMSystem::Checkpoint(CheckpointWriter &out) {
+    SyncControllers();
+    out.Put(clk_);
+    out.Put(last_req_clk_);
+    out.Put(next_trans_id_);
+    // completions the caller has not polled yet
+    out.Put(static_cast<uint64_t>(completions_.Size()));
+    for (size_t i = 0; i < completions_.Size(); i++) {
+        const auto &done = completions_[i];
+        out.Put(done.id);
+        out.Put(done.tag);
+        out.Put(done.addr);
+        out.Put(done.added_cycle);
+        out.Put(done.complete_cycle);
+        out.Put(done.is_write);
+    }
+    out.Put(static_cast<uint64_t>(ctrls_.size()));
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        ctrls_[i]->Checkpoint(out);
+    }
+}
+
+void BaseDRAMSystem::Restore(CheckpointReader &in) {
+    in.Get(clk_);
+    in.Get(last_req_clk_);
+    in.Get(next_trans_id_);
+    size_t num_completions = in.GetSize();
+    for (size_t i = 0; i < num_completions; i++) {
+        Completion done;
+        in.Get(done.id);
+        in.Get(done.tag);
+        in.Get(done.addr);
+        in.Get(done.added_cycle);
+        in.Get(done.complete_cycle);
+        in.Get(done.is_write);
+        completions_.Push(done);
+    }
+    in.Expect(ctrls_.size(), "channels");
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        ctrls_[i]->Restore(in);
+    }
+    // the epoch stats of the run that took the checkpoint stay with it,
+    // start a new epoch file as the first epoch would have
+    std::ofstream epoch_out(config_.json_epoch_name, std::ofstream::out);
+    epoch_out << "[";
+}
+
 void BaseDRAMSystem::PrintEpochStats() {
+    SyncControllers();
     // first epoch, print bracket
     if (clk_ - config_.epoch_period == 0) {
         std::ofstream epoch_out(config_.json_epoch_name, std::ofstream::out);
@@ -51,6 +178,7 @@ void BaseDRAMSystem::PrintEpochStats() {
 }
 
 void BaseDRAMSystem::PrintStats() {
+    SyncControllers();
     // Finish epoch output, remove last comma and append ]
     std::ofstream epoch_out(config_.json_epoch_name, std::ios_base::in |
                                                          std::ios_base::out |
@@ -80,6 +208,7 @@ void BaseDRAMSystem::PrintStats() {
 }
 
 void BaseDRAMSystem::ResetStats() {
+    SyncControllers();
     for (size_t i = 0; i < ctrls_.size(); i++) {
         ctrls_[i]->ResetStats();
     }
@@ -96,13 +225,36 @@ void BaseDRAMSystem::RegisterCallbacks(
 JedecDRAMSystem::JedecDRAMSystem(Config &config, const std::string &output_dir,
                                  std::function<void(uint64_t)> read_callback,
                                  std::function<void(uint64_t)> write_callback)
-    : BaseDRAMSystem(config, output_dir, read_callback, write_callback) {
+    : BaseDRAMSystem(config, output_dir, read_callback, write_callback),
+      functional_(false),
+      next_event_clk_(0),
+      synced_clk_(0),
+      pending_trans_(config_.channels),
+      done_trans_(config_.channels),
+      log_records_(config_.channels) {
     if (config_.IsHMC()) {
         std::cerr << "Initialized a memory system with an HMC config file!"
                   << std::endl;
         AbruptExit(__FILE__, __LINE__);
     }
 
+    // more spinning workers than CPUs would only spin against each other
+    int num_threads = std::min(config_.channel_threads, config_.channels);
+    int num_cpus = static_cast<int>(ThreadPool::AllowedCpus().size());
+    if (num_cpus > 0) {
+        num_threads = std::min(num_threads, num_cpus);
+    }
+#ifdef THERMAL
+    if (num_threads > 1) {
+        std::cerr << "Thermal model is not thread safe, channels will be "
+                     "simulated serially" << std::endl;
+        num_threads = 1;
+    }
+#endif  // THERMAL
+    if (num_threads > 1) {
+        thread_pool_.reset(new ThreadPool(num_threads, config_.pin_threads));
+    }
+
     ctrls_.reserve(config_.channels);
     for (auto i = 0; i < config_.channels; i++) {
 #ifdef THERMAL
@@ -121,41 +273,113 @@ JedecDRAMSystem::~JedecDRAMSystem() {
 
 bool JedecDRAMSystem::WillAcceptTransaction(uint64_t hex_addr,
                                             bool is_write) const {
-    int channel = GetChannel(hex_addr);
+    return ChannelWillAccept(GetChannel(hex_addr), hex_addr, is_write);
+}
+
+bool JedecDRAMSystem::ChannelWillAccept(int channel, uint64_t hex_addr,
+                                        bool is_write) const {
+    if (!pending_trans_[channel].empty()) {
+        // buffered transactions only enter the queues on the next sync,
+        // conservatively assume none of them will be merged
+        int pending = 0;
+        for (const auto &trans : pending_trans_[channel]) {
+            if (config_.unified_queue || trans.is_write == is_write) {
+                pending++;
+            }
+        }
+        return ctrls_[channel]->TransQueueVacancy(is_write) > pending;
+    }
     return ctrls_[channel]->WillAcceptTransaction(hex_addr, is_write);
 }
 
-bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write) {
+bool JedecDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                     uint64_t tag) {
+    FinishFunctional();
+    int channel = GetChannel(hex_addr);
+    bool ok = ChannelWillAccept(channel, hex_addr, is_write);
+
+    assert(ok);
+    if (ok) {
+        AddToChannel(channel, hex_addr, is_write, tag);
+    }
+    last_req_clk_ = clk_;
+    return ok;
+}
+
+size_t JedecDRAMSystem::AddTransactions(const Transaction *trans, size_t count,
+                                        std::vector<int> &accepted) {
+    FinishFunctional();
+    accepted.assign(config_.channels, 0);
+    refused_.assign(config_.channels, false);
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        int channel = GetChannel(trans[i].addr);
+        if (refused_[channel] ||
+            !ChannelWillAccept(channel, trans[i].addr, trans[i].is_write)) {
+            refused_[channel] = true;
+            continue;
+        }
+        AddToChannel(channel, trans[i].addr, trans[i].is_write,
+                     trans[i].tag);
+        accepted[channel]++;
+        total++;
+    }
+    if (total > 0) {
+        last_req_clk_ = clk_;
+    }
+    return total;
+}
+
+void JedecDRAMSystem::AddToChannel(int channel, uint64_t hex_addr,
+                                   bool is_write, uint64_t tag) {
 // Record trace - Record address trace for debugging or other purposes
 #ifdef ADDR_TRACE
     address_trace_ << std::hex << hex_addr << std::dec << " "
                    << (is_write ? "WRITE " : "READ ") << clk_ << std::endl;
 #endif
 
-    int channel = GetChannel(hex_addr);
-    bool ok = ctrls_[channel]->WillAcceptTransaction(hex_addr, is_write);
-
-    assert(ok);
-    if (ok) {
-        Transaction trans = Transaction(hex_addr, is_write);
+    Transaction trans = Transaction(hex_addr, is_write);
+    trans.id = next_trans_id_++;
+    trans.tag = tag;
+    if (thread_pool_ && synced_clk_ != clk_) {
+        trans.added_cycle = clk_;
+        pending_trans_[channel].push_back(trans);
+    } else {
+        ctrls_[channel]->FastForward(clk_);
         ctrls_[channel]->AddTransaction(trans);
+        next_event_clk_ = clk_;
     }
-    last_req_clk_ = clk_;
-    return ok;
 }
 
 void JedecDRAMSystem::ClockTick() {
+    FinishFunctional();
+    if (thread_pool_) {
+        clk_++;
+        if (clk_ % config_.sync_quantum == 0) {
+            SyncControllers();
+        }
+        if (clk_ % config_.epoch_period == 0) {
+            PrintEpochStats();
+        }
+        return;
+    }
+
+    if (config_.event_driven && clk_ < next_event_clk_) {
+        // nothing can happen this cycle, controllers catch up lazily
+        clk_++;
+        if (clk_ % config_.epoch_period == 0) {
+            PrintEpochStats();
+        }
+        return;
+    }
+
+    SyncControllers();
     for (size_t i = 0; i < ctrls_.size(); i++) {
         // look ahead and return earlier
-        while (true) {
-            auto pair = ctrls_[i]->ReturnDoneTrans(clk_);
-            if (pair.second == 1) {
-                write_callback_(pair.first);
-            } else if (pair.second == 0) {
-                read_callback_(pair.first);
-            } else {
-                break;
-            }
+        returned_trans_.clear();
+        ctrls_[i]->ReturnAllDoneTrans(clk_, returned_trans_);
+        for (const auto &trans : returned_trans_) {
+            Complete(trans, clk_);
         }
     }
     for (size_t i = 0; i < ctrls_.size(); i++) {
@@ -163,45 +387,290 @@ void JedecDRAMSystem::ClockTick() {
     }
     clk_++;
 
+    if (config_.event_driven) {
+        next_event_clk_ = NextEventCycle();
+    }
+
     if (clk_ % config_.epoch_period == 0) {
         PrintEpochStats();
     }
     return;
 }
 
+void JedecDRAMSystem::RunUntil(uint64_t clk) {
+    FinishFunctional();
+    while (clk_ < clk) {
+        // jump over the cycles ClockTick() would only count, stopping at
+        // the epoch and sync boundaries it acts on
+        uint64_t stop = clk;
+        if (thread_pool_) {
+            uint64_t quantum = config_.sync_quantum;
+            stop = std::min(stop, (clk_ / quantum + 1) * quantum);
+        } else if (config_.event_driven && clk_ < next_event_clk_) {
+            stop = std::min(stop, next_event_clk_);
+        } else {
+            ClockTick();
+            continue;
+        }
+        uint64_t epoch = config_.epoch_period;
+        clk_ = std::min(stop, (clk_ / epoch + 1) * epoch);
+        if (thread_pool_ && clk_ % config_.sync_quantum == 0) {
+            SyncControllers();
+        }
+        if (clk_ % epoch == 0) {
+            PrintEpochStats();
+        }
+    }
+}
+
+void JedecDRAMSystem::Drain() {
+    SyncControllers();
+    while (Outstanding() > 0) {
+        // the parallel engine only calls back when it syncs
+        uint64_t clk = clk_ + 1;
+        if (thread_pool_) {
+            uint64_t quantum = config_.sync_quantum;
+            clk = (clk_ / quantum + 1) * quantum;
+        } else if (config_.event_driven) {
+            clk = std::max(clk, next_event_clk_);
+        }
+        RunUntil(clk);
+    }
+}
+
+uint64_t JedecDRAMSystem::Outstanding() const {
+    uint64_t outstanding = 0;
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        outstanding += ctrls_[i]->Outstanding() + pending_trans_[i].size();
+    }
+    return outstanding;
+}
+
+void JedecDRAMSystem::FunctionalAccess(uint64_t hex_addr, bool is_write) {
+    StartFunctional();
+    // only the controller accessed is brought up to clk_
+    int channel = GetChannel(hex_addr);
+    ctrls_[channel]->FunctionalForward(clk_);
+    ctrls_[channel]->FunctionalAccess(hex_addr, is_write);
+    last_req_clk_ = clk_;
+}
+
+void JedecDRAMSystem::FunctionalAdvance(uint64_t cycles) {
+    StartFunctional();
+    clk_ += cycles;
+}
+
+void JedecDRAMSystem::StartFunctional() {
+    if (!functional_) {
+        SyncControllers();
+        functional_ = true;
+    }
+}
+
+void JedecDRAMSystem::FinishFunctional() {
+    if (!functional_) {
+        return;
+    }
+    functional_ = false;
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        ctrls_[i]->FunctionalForward(clk_);
+    }
+    synced_clk_ = clk_;
+    next_event_clk_ = clk_;
+}
+
+void JedecDRAMSystem::Checkpoint(CheckpointWriter &out) {
+    // syncing delivers whatever the parallel batches had pending
+    BaseDRAMSystem::Checkpoint(out);
+    out.Put(next_event_clk_);
+}
+
+void JedecDRAMSystem::Restore(CheckpointReader &in) {
+    BaseDRAMSystem::Restore(in);
+    in.Get(next_event_clk_);
+    synced_clk_ = clk_;
+}
+
+void JedecDRAMSystem::SyncControllers() {
+    FinishFunctional();
+    if (!thread_pool_) {
+        BaseDRAMSystem::SyncControllers();
+        return;
+    }
+    if (synced_clk_ == clk_) {
+        return;
+    }
+    int num_workers = thread_pool_->NumWorkers();
+    std::function<void(int)> job = [this, num_workers](int worker) {
+        for (size_t i = worker; i < ctrls_.size(); i += num_workers) {
+            RunChannel(i, clk_);
+        }
+    };
+    thread_pool_->Run(job);
+    synced_clk_ = clk_;
+    DeliverDoneTrans();
+}
+
+void JedecDRAMSystem::RunChannel(int channel, uint64_t clk) {
+    // exactly what the serial ClockTick() does for this channel
+    Controller *ctrl = ctrls_[channel];
+    auto &pending = pending_trans_[channel];
+    auto &done = done_trans_[channel];
+    size_t next_trans = 0;
+    uint64_t next_event = 0;
+    Logger::Capture(&log_records_[channel]);
+    for (uint64_t t = synced_clk_; t < clk; t++) {
+        bool trans_due = next_trans < pending.size() &&
+                         pending[next_trans].added_cycle <= t;
+        if (config_.event_driven && t < next_event && !trans_due) {
+            continue;
+        }
+        ctrl->FastForward(t);
+        while (next_trans < pending.size() &&
+               pending[next_trans].added_cycle <= t) {
+            ctrl->AddTransaction(pending[next_trans]);
+            next_trans++;
+        }
+        size_t first_done = done.size();
+        ctrl->ReturnAllDoneTrans(t, done);
+        for (size_t j = first_done; j < done.size(); j++) {
+            done[j].complete_cycle = t;
+        }
+        ctrl->ClockTick();
+        if (config_.event_driven) {
+            next_event = ctrl->NextEventCycle();
+        }
+    }
+    Logger::Capture(nullptr);
+    ctrl->FastForward(clk);
+    // added after the last tick of the batch
+    while (next_trans < pending.size()) {
+        ctrl->AddTransaction(pending[next_trans]);
+        next_trans++;
+    }
+    pending.clear();
+    return;
+}
+
+void JedecDRAMSystem::DeliverDoneTrans() {
+    // a serial cycle logs the returns of every channel, then the issues
+    std::vector<size_t> heads(log_records_.size(), 0);
+    while (true) {
+        uint64_t cycle = std::numeric_limits<uint64_t>::max();
+        for (size_t i = 0; i < log_records_.size(); i++) {
+            if (heads[i] < log_records_[i].size()) {
+                cycle = std::min(cycle, log_records_[i][heads[i]].cycle);
+            }
+        }
+        if (cycle == std::numeric_limits<uint64_t>::max()) {
+            break;
+        }
+        for (unsigned kind : {LOG_RETURN, LOG_ISSUE}) {
+            for (size_t i = 0; i < log_records_.size(); i++) {
+                auto &records = log_records_[i];
+                while (heads[i] < records.size() &&
+                       records[heads[i]].cycle == cycle &&
+                       records[heads[i]].kind == kind) {
+                    Logger::Write(records[heads[i]]);
+                    heads[i]++;
+                }
+            }
+        }
+    }
+    for (auto &records : log_records_) {
+        records.clear();
+    }
+
+    // merge per channel completions in the order the serial engine returns
+    // them: by cycle first, then by channel
+    heads.assign(done_trans_.size(), 0);
+    while (true) {
+        int channel = -1;
+        uint64_t min_cycle = std::numeric_limits<uint64_t>::max();
+        for (size_t i = 0; i < done_trans_.size(); i++) {
+            if (heads[i] < done_trans_[i].size() &&
+                done_trans_[i][heads[i]].complete_cycle < min_cycle) {
+                min_cycle = done_trans_[i][heads[i]].complete_cycle;
+                channel = i;
+            }
+        }
+        if (channel < 0) {
+            break;
+        }
+        auto &queue = done_trans_[channel];
+        while (heads[channel] < queue.size() &&
+               queue[heads[channel]].complete_cycle == min_cycle) {
+            const auto &trans = queue[heads[channel]];
+            Complete(trans, trans.complete_cycle);
+            heads[channel]++;
+        }
+    }
+    for (auto &queue : done_trans_) {
+        queue.clear();
+    }
+    return;
+}
+
 IdealDRAMSystem::IdealDRAMSystem(Config &config, const std::string &output_dir,
                                  std::function<void(uint64_t)> read_callback,
                                  std::function<void(uint64_t)> write_callback)
     : BaseDRAMSystem(config, output_dir, read_callback, write_callback),
-      latency_(config_.ideal_memory_latency) {}
+      latency_(config_.ideal_memory_latency),
+      bandwidth_(config_.ideal_memory_bandwidth),
+      added_this_cycle_(0),
+      pipeline_(64) {}
 
 IdealDRAMSystem::~IdealDRAMSystem() {}
 
-bool IdealDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write) {
-    auto trans = Transaction(hex_addr, is_write);
+bool IdealDRAMSystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                     uint64_t tag) {
+    if (!WillAcceptTransaction(hex_addr, is_write)) {
+        return false;
+    }
+    Transaction trans(hex_addr, is_write);
+    trans.id = next_trans_id_++;
+    trans.tag = tag;
     trans.added_cycle = clk_;
-    infinite_buffer_q_.push_back(trans);
+    pipeline_.Push(trans);
+    added_this_cycle_++;
     return true;
 }
 
 void IdealDRAMSystem::ClockTick() {
-    for (auto trans_it = infinite_buffer_q_.begin();
-         trans_it != infinite_buffer_q_.end();) {
-        if (clk_ - trans_it->added_cycle >= static_cast<uint64_t>(latency_)) {
-            if (trans_it->is_write) {
-                write_callback_(trans_it->addr);
-            } else {
-                read_callback_(trans_it->addr);
-            }
-            trans_it = infinite_buffer_q_.erase(trans_it++);
-        }
-        if (trans_it != infinite_buffer_q_.end()) {
-            ++trans_it;
+    while (!pipeline_.Empty()) {
+        if (clk_ - pipeline_.Front().added_cycle <
+            static_cast<uint64_t>(latency_)) {
+            break;
         }
+        // pop before completing, a callback may add new transactions
+        Transaction trans = pipeline_.Front();
+        pipeline_.Pop();
+        Complete(trans, clk_);
     }
 
+    added_this_cycle_ = 0;
     clk_++;
     return;
 }
 
+void IdealDRAMSystem::Checkpoint(CheckpointWriter &out) {
+    BaseDRAMSystem::Checkpoint(out);
+    out.Put(added_this_cycle_);
+    out.Put(static_cast<uint64_t>(pipeline_.Size()));
+    for (size_t i = 0; i < pipeline_.Size(); i++) {
+        out.Put(pipeline_[i]);
+    }
+}
+
+void IdealDRAMSystem::Restore(CheckpointReader &in) {
+    BaseDRAMSystem::Restore(in);
+    in.Get(added_this_cycle_);
+    size_t num_trans = in.GetSize();
+    for (size_t i = 0; i < num_trans; i++) {
+        Transaction trans;
+        in.Get(trans);
+        pipeline_.Push(trans);
+    }
+}
+
 }  // namespace dramsim3
@@ -2,12 +2,17 @@
 #define __DRAM_SYSTEM_H
 
 #include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "checkpoint.h"
 #include "common.h"
 #include "configuration.h"
 #include "controller.h"
+#include "logger.h"
+#include "ring_buffer.h"
+#include "thread_pool.h"
 #include "timing.h"
 
 #ifdef THERMAL
@@ -24,15 +29,46 @@ class BaseDRAMSystem {
     virtual ~BaseDRAMSystem() {}
     void RegisterCallbacks(std::function<void(uint64_t)> read_callback,
                            std::function<void(uint64_t)> write_callback);
+    // completions go to a queue polled with PollCompletions() instead of
+    // the callbacks, capacity is where the queue starts before growing
+    void EnableCompletionQueue(size_t capacity);
+    size_t PollCompletions(Completion *completions, size_t max_count);
     void PrintEpochStats();
     void PrintStats();
     void ResetStats();
 
     virtual bool WillAcceptTransaction(uint64_t hex_addr,
                                        bool is_write) const = 0;
-    virtual bool AddTransaction(uint64_t hex_addr, bool is_write) = 0;
+    // tag is handed back untouched with the completion
+    virtual bool AddTransaction(uint64_t hex_addr, bool is_write,
+                                uint64_t tag) = 0;
     virtual void ClockTick() = 0;
     int GetChannel(uint64_t hex_addr) const;
+    uint64_t GetClock() const { return clk_; }
+
+    // Bulk versions of the calls above. AddTransactions() adds the count
+    // transactions in order, a channel takes none after the first one it
+    // refuses; accepted[c] is how many went to channel c, the total is
+    // returned. RunUntil() ticks until clk_ reaches clk, Drain() until every
+    // transaction added has been called back.
+    virtual size_t AddTransactions(const Transaction *trans, size_t count,
+                                   std::vector<int> &accepted);
+    virtual void RunUntil(uint64_t clk);
+    virtual void Drain();
+    // transactions added and not called back yet
+    virtual uint64_t Outstanding() const = 0;
+
+    // Functional fast-forward for sampled simulation: an access only moves
+    // the open rows and advancing time only the refresh phase, nothing is
+    // timed, queued or counted in the stats. Expects no transaction in
+    // flight, the next detailed call brings the controllers up to clk_.
+    virtual void FunctionalAccess(uint64_t hex_addr, bool is_write);
+    virtual void FunctionalAdvance(uint64_t cycles);
+
+    // Checkpoint() brings every controller up to clk_ first, Restore()
+    // expects a freshly constructed system
+    virtual void Checkpoint(CheckpointWriter &out);
+    virtual void Restore(CheckpointReader &in);
 
     std::function<void(uint64_t req_id)> read_callback_, write_callback_;
     static int total_channels_;
@@ -40,6 +76,7 @@ class BaseDRAMSystem {
    protected:
     uint64_t id_;
     uint64_t last_req_clk_;
+    uint64_t next_trans_id_;
     Config &config_;
     Timing timing_;
     uint64_t parallel_cycles_;
@@ -51,6 +88,27 @@ class BaseDRAMSystem {
 
     uint64_t clk_;
     std::vector<Controller*> ctrls_;
+    // scratch for AddTransactions()
+    std::vector<bool> refused_;
+
+    bool poll_completions_;
+    RingBuffer<Completion> completions_;
+    void Complete(const Transaction &trans, uint64_t complete_cycle) {
+        if (poll_completions_) {
+            completions_.Push(Completion{trans.id, trans.tag, trans.addr,
+                                         trans.added_cycle, complete_cycle,
+                                         trans.is_write});
+        } else if (trans.is_write) {
+            write_callback_(trans.addr);
+        } else {
+            read_callback_(trans.addr);
+        }
+    }
+
+    // bring controllers that lag behind (e.g. fast-forwarded) up to clk_
+    virtual void SyncControllers();
+    // earliest cycle any controller has something to do in
+    uint64_t NextEventCycle() const;
 
 #ifdef ADDR_TRACE
     std::ofstream address_trace_;
@@ -65,8 +123,48 @@ class JedecDRAMSystem : public BaseDRAMSystem {
                     std::function<void(uint64_t)> write_callback);
     ~JedecDRAMSystem();
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const override;
-    bool AddTransaction(uint64_t hex_addr, bool is_write) override;
+    bool AddTransaction(uint64_t hex_addr, bool is_write,
+                        uint64_t tag) override;
     void ClockTick() override;
+    size_t AddTransactions(const Transaction *trans, size_t count,
+                           std::vector<int> &accepted) override;
+    void RunUntil(uint64_t clk) override;
+    void Drain() override;
+    uint64_t Outstanding() const override;
+    void FunctionalAccess(uint64_t hex_addr, bool is_write) override;
+    void FunctionalAdvance(uint64_t cycles) override;
+    void Checkpoint(CheckpointWriter &out) override;
+    void Restore(CheckpointReader &in) override;
+
+   private:
+    // the single and bulk calls once the channel is known
+    bool ChannelWillAccept(int channel, uint64_t hex_addr,
+                           bool is_write) const;
+    void AddToChannel(int channel, uint64_t hex_addr, bool is_write,
+                      uint64_t tag);
+
+    // controllers lag behind clk_ in functional mode
+    bool functional_;
+    void StartFunctional();
+    void FinishFunctional();
+
+    // event driven mode: no controller can do anything before this cycle
+    uint64_t next_event_clk_;
+
+    // parallel mode: channels are ticked in batches up to clk_ on the thread
+    // pool, transactions added in between are replayed at the cycle they
+    // were added and completions (and log records) are delivered in serial
+    // (cycle, channel) order after each batch
+    std::unique_ptr<ThreadPool> thread_pool_;
+    uint64_t synced_clk_;
+    std::vector<std::vector<Transaction>> pending_trans_;
+    std::vector<std::vector<Transaction>> done_trans_;
+    std::vector<std::vector<LogRecord>> log_records_;
+    // scratch buffer for completions returned in ClockTick()
+    std::vector<Transaction> returned_trans_;
+    void SyncControllers() override;
+    void RunChannel(int channel, uint64_t clk);
+    void DeliverDoneTrans();
 };
 
 // Model a memorysystem with an infinite bandwidth and a fixed latency (possibly
@@ -80,14 +178,25 @@ class IdealDRAMSystem : public BaseDRAMSystem {
     ~IdealDRAMSystem();
     bool WillAcceptTransaction(uint64_t hex_addr,
                                bool is_write) const override {
-        return true;
+        return bandwidth_ == 0 || added_this_cycle_ < bandwidth_;
     };
-    bool AddTransaction(uint64_t hex_addr, bool is_write) override;
+    bool AddTransaction(uint64_t hex_addr, bool is_write,
+                        uint64_t tag) override;
     void ClockTick() override;
+    uint64_t Outstanding() const override { return pipeline_.Size(); }
+    void FunctionalAccess(uint64_t hex_addr, bool is_write) override {}
+    void FunctionalAdvance(uint64_t cycles) override { clk_ += cycles; }
+    void Checkpoint(CheckpointWriter &out) override;
+    void Restore(CheckpointReader &in) override;
 
    private:
     int latency_;
-    std::vector<Transaction> infinite_buffer_q_;
+    int bandwidth_;
+    int added_this_cycle_;
+
+    // every transaction takes latency_ cycles so they complete in the order
+    // they were added, a ring buffer FIFO (grown when full) is all it takes
+    RingBuffer<Transaction> pipeline_;
 };
 
 }  // namespace dramsim3
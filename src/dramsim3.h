@@ -1,8 +1,12 @@
 #ifndef __MEMORY_SYSTEM__H
 #define __MEMORY_SYSTEM__H
 
+#include <stdint.h>
 #include <functional>
 #include <string>
+#include <vector>
+
+#include "common.h"
 
 namespace dramsim3 {
 
@@ -16,6 +20,12 @@ class MemorySystem {
     void ClockTick();
     void RegisterCallbacks(std::function<void(uint64_t)> read_callback,
                            std::function<void(uint64_t)> write_callback);
+    // Deliver completions to a queue instead of the callbacks, the caller
+    // drains it with PollCompletions(), e.g. after ClockTick(cycles). Ids
+    // count the accepted transactions from 0. capacity is only where the
+    // queue starts, it grows if it is not drained in time.
+    void EnableCompletionQueue(size_t capacity);
+    size_t PollCompletions(Completion *completions, size_t max_count);
     double GetTCK() const;
     int GetBusBits() const;
     int GetBurstLength() const;
@@ -25,6 +35,35 @@ class MemorySystem {
 
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const;
     bool AddTransaction(uint64_t hex_addr, bool is_write);
+    // tag comes back in the completion record, see PollCompletions()
+    bool AddTransaction(uint64_t hex_addr, bool is_write, uint64_t tag);
+
+    // Bulk calls: AddTransactions() adds trans in order (only their addr,
+    // is_write and tag are read), a channel takes none after the first one
+    // it refuses, accepted[c] is how many went to channel c and the total
+    // is returned. ClockTick(cycles) and RunUntil() tick many cycles at
+    // once, Drain() runs until every transaction added has been called
+    // back.
+    size_t AddTransactions(const Transaction *trans, size_t count,
+                           std::vector<int> &accepted);
+    void ClockTick(uint64_t cycles);
+    void RunUntil(uint64_t clk);
+    void Drain();
+    uint64_t GetClock() const;
+
+    // Functional fast-forward for sampled simulation, between detailed
+    // windows and with no transaction in flight: an access only opens its
+    // row and advancing the clock only moves the refresh phase
+    void FunctionalAccess(uint64_t hex_addr, bool is_write);
+    void FunctionalAdvance(uint64_t cycles);
+
+    // Save the whole simulator state to / load it from a checkpoint file,
+    // restoring only works right after construction and with a config that
+    // only differs in its [other] section. false if the file could not be
+    // written or read, or belongs to another config. Saving first brings
+    // every channel up to the current cycle, which can deliver completions.
+    bool SaveCheckpoint(const std::string &file_name);
+    bool RestoreCheckpoint(const std::string &file_name);
 };
 
 MemorySystem* GetMemorySystem(const std::string &config_file, const std::string &output_dir,
@@ -4,6 +4,8 @@
 #include <string>
 #include <cmath>
 #include <cstdlib>
+#include "trace_codec.h"
+#include "trace_file.h"
 
 void GenerateTrace(const std::string& output_path,
                    size_t element_size,
@@ -26,10 +28,56 @@ void GenerateTrace(const std::string& output_path,
     std::cout << "[Generator] Trace written to: " << output_path << "\n";
 }
 
+void GenerateBinaryTrace(const std::string& output_path,
+                         size_t element_size,
+                         size_t start_idx,
+                         size_t stride,
+                         size_t count,
+                         bool   is_write) {
+    dramsim3::TraceWriter writer;
+    if (!writer.Open(output_path, 0)) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t addr = static_cast<uint64_t>(start_idx + i * stride) * element_size;
+        writer.Append(addr, is_write);
+    }
+    writer.Close();
+
+    std::cout << "[Generator] Binary trace written to: " << output_path << "\n";
+}
+
+void GenerateCompressedTrace(const std::string& output_path,
+                             size_t element_size,
+                             size_t start_idx,
+                             size_t stride,
+                             size_t count,
+                             bool   is_write) {
+    dramsim3::TraceEncoder encoder;
+    if (!encoder.Open(output_path, 0)) {
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t addr = static_cast<uint64_t>(start_idx + i * stride) * element_size;
+        encoder.Append(addr, is_write);
+    }
+    encoder.Close();
+
+    std::cout << "[Generator] Compressed trace written to: " << output_path << "\n";
+}
+
+bool HasExtension(const std::string& path, const std::string& ext) {
+    return path.size() >= ext.size() &&
+           path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 5) {
+    if (argc != 5 && argc != 6) {
         std::cerr << "Usage: " << argv[0]
-                  << " <start_idx> <stride_exp> <count> <is_write: 0|1>\n";
+                  << " <start_idx> <stride_exp> <count> <is_write: 0|1>"
+                  << " [output_path, binary if it ends in .bin, compressed if .trz]\n";
         return 1;
     }
 
@@ -40,6 +88,14 @@ int main(int argc, char* argv[]) {
     size_t count = std::stoull(argv[3]);
     bool is_write = std::stoi(argv[4]) != 0;
 
-    GenerateTrace("traces/test.trace", element_size, start_idx, stride, count, is_write);
+    std::string output_path = argc == 6 ? argv[5] : "traces/test.trace";
+
+    if (HasExtension(output_path, ".bin")) {
+        GenerateBinaryTrace(output_path, element_size, start_idx, stride, count, is_write);
+    } else if (HasExtension(output_path, ".trz")) {
+        GenerateCompressedTrace(output_path, element_size, start_idx, stride, count, is_write);
+    } else {
+        GenerateTrace(output_path, element_size, start_idx, stride, count, is_write);
+    }
     return 0;
 }
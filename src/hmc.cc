@@ -1,9 +1,17 @@
 #include "hmc.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace dramsim3 {
 
 HMCRequest::HMCRequest(HMCReqType req_type, uint64_t hex_addr, int vault)
-    : type(req_type), mem_operand(hex_addr), vault(vault) {
+    : type(req_type),
+      mem_operand(hex_addr),
+      id(0),
+      tag(0),
+      vault(vault),
+      resp(nullptr) {
     is_write = type >= HMCReqType::WR0 && type <= HMCReqType::P_WR256;
     // given that vaults could be 16 (Gen1) or 32(Gen2), using % 4
     // to partition vaults to quads
@@ -109,10 +117,14 @@ HMCRequest::HMCRequest(HMCReqType req_type, uint64_t hex_addr, int vault)
     }
 }
 
-HMCResponse::HMCResponse(uint64_t id, HMCReqType req_type, int dest_link,
-                         int src_quad)
-    : resp_id(id), link(dest_link), quad(src_quad) {
-    switch (req_type) {
+HMCResponse::HMCResponse(const HMCRequest &req, int dest_link)
+    : resp_id(req.mem_operand),
+      id(req.id),
+      tag(req.tag),
+      added_cycle(0),
+      link(dest_link),
+      quad(req.quad) {
+    switch (req.type) {
         case HMCReqType::RD0:
             type = HMCRespType::RD_RS;
             flits = 0;
@@ -247,6 +259,7 @@ HMCMemorySystem::HMCMemorySystem(Config &config, const std::string &output_dir,
       logic_clk_(0),
       logic_ps_(0),
       dram_ps_(0),
+      next_vault_clk_(0),
       next_link_(0) {
     // sanity check, this constructor should only be intialized using HMC
     if (!config_.IsHMC()) {
@@ -273,19 +286,23 @@ HMCMemorySystem::HMCMemorySystem(Config &config, const std::string &output_dir,
     // quadrant)
     queue_depth_ = static_cast<size_t>(config_.xbar_queue_depth);
     links_ = config_.num_links;
+    if (links_ < 1 || links_ > 32) {
+        std::cerr << "HMC supports 1 to 32 links, not " << links_ << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
     link_req_queues_.reserve(links_);
     link_resp_queues_.reserve(links_);
     for (int i = 0; i < links_; i++) {
-        link_req_queues_.push_back(std::vector<HMCRequest *>());
-        link_resp_queues_.push_back(std::vector<HMCResponse *>());
+        link_req_queues_.emplace_back(queue_depth_);
+        link_resp_queues_.emplace_back(queue_depth_);
     }
 
     // don't want to hard coding it but there are 4 quads so it's kind of fixed
     quad_req_queues_.reserve(4);
     quad_resp_queues_.reserve(4);
     for (int i = 0; i < 4; i++) {
-        quad_req_queues_.push_back(std::vector<HMCRequest *>());
-        quad_resp_queues_.push_back(std::vector<HMCResponse *>());
+        quad_req_queues_.emplace_back(queue_depth_);
+        quad_resp_queues_.emplace_back(queue_depth_);
     }
 
     link_busy_.reserve(links_);
@@ -302,22 +319,45 @@ HMCMemorySystem::~HMCMemorySystem() {
     }
 }
 
+void HMCMemorySystem::Checkpoint(CheckpointWriter &out) {
+    std::cerr << "Checkpoints are not supported for HMC" << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+}
+
+void HMCMemorySystem::Restore(CheckpointReader &in) {
+    std::cerr << "Checkpoints are not supported for HMC" << std::endl;
+    AbruptExit(__FILE__, __LINE__);
+}
+
 void HMCMemorySystem::SetClockRatio() {
     // There are 3 clock domains here, Link (super fast), logic (fast), DRAM
-    // (slow) We assume the logic process 1 flit per logic cycle and since the
-    // link takes several cycles to process 1 flit (128b), we can deduce logic
-    // speed according to link speed
+    // (slow). A link takes several cycles to serialize 1 flit (128b), unless
+    // logic_speed is given we assume the logic processes 1 flit per logic
+    // cycle and deduce its speed from the link speed
     ps_per_dram_ = 800;  // 800 ps
     int link_cycles_per_flit = 128 / config_.link_width;
-    int logic_speed = config_.link_speed / link_cycles_per_flit;  // MHz
-    ps_per_logic_ =
-        static_cast<uint64_t>(1000000 / static_cast<double>(logic_speed));
+    if (config_.logic_speed > 0) {
+        ps_per_logic_ = static_cast<uint64_t>(
+            1000000 / static_cast<double>(config_.logic_speed));
+        ps_per_flit_ = static_cast<uint64_t>(
+            1000000 * link_cycles_per_flit /
+            static_cast<double>(config_.link_speed));
+    } else {
+        int logic_speed = config_.link_speed / link_cycles_per_flit;  // MHz
+        ps_per_logic_ =
+            static_cast<uint64_t>(1000000 / static_cast<double>(logic_speed));
+        ps_per_flit_ = ps_per_logic_;
+    }
     if (ps_per_logic_ > ps_per_dram_) {
         ps_per_logic_ = ps_per_dram_;
     }
     return;
 }
 
+uint64_t HMCMemorySystem::LinkCycles(int flits) const {
+    return (flits * ps_per_flit_ + ps_per_logic_ - 1) / ps_per_logic_;
+}
+
 inline void HMCMemorySystem::IterateNextLink() {
     // determinining which link a request goes to has great impact on
     // performance round robin , we can implement other schemes here later such
@@ -332,7 +372,7 @@ bool HMCMemorySystem::WillAcceptTransaction(uint64_t hex_addr,
     bool insertable = false;
     for (auto link_queue = link_req_queues_.begin();
          link_queue != link_req_queues_.end(); link_queue++) {
-        if ((*link_queue).size() < queue_depth_) {
+        if ((*link_queue).Size() < queue_depth_) {
             insertable = true;
             break;
         }
@@ -340,7 +380,8 @@ bool HMCMemorySystem::WillAcceptTransaction(uint64_t hex_addr,
     return insertable;
 }
 
-bool HMCMemorySystem::AddTransaction(uint64_t hex_addr, bool is_write) {
+bool HMCMemorySystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                     uint64_t tag) {
     // to be compatible with other protocol we have this interface
     // when using this intreface the size of each transaction will be block_size
     HMCReqType req_type;
@@ -390,23 +431,24 @@ bool HMCMemorySystem::AddTransaction(uint64_t hex_addr, bool is_write) {
         }
     }
     int vault = GetChannel(hex_addr);
-    HMCRequest *req = new HMCRequest(req_type, hex_addr, vault);
+    HMCRequest req(req_type, hex_addr, vault);
+    req.tag = tag;
     return InsertHMCReq(req);
 }
 
-bool HMCMemorySystem::InsertReqToLink(HMCRequest *req, int link) {
+bool HMCMemorySystem::InsertReqToLink(const HMCRequest &req, int link) {
     // These things need to happen when an HMC request is inserted to a link:
     // 1. check if link queue full
     // 2. set link field in the request packet
     // 3. create corresponding response
     // 4. increment link_age_counter_ so that arbitrate logic works
-    if (link_req_queues_[link].size() < queue_depth_) {
-        req->link = link;
-        link_req_queues_[link].push_back(req);
-        HMCResponse *resp =
-            new HMCResponse(req->mem_operand, req->type, link, req->quad);
-        resp_lookup_table_.insert(
-            std::pair<uint64_t, HMCResponse *>(resp->resp_id, resp));
+    if (link_req_queues_[link].Size() < queue_depth_) {
+        HMCRequest *new_req = req_pool_.New(req);
+        new_req->link = link;
+        new_req->id = next_trans_id_++;
+        new_req->resp = resp_pool_.New(*new_req, link);
+        new_req->resp->added_cycle = clk_;
+        link_req_queues_[link].Push(new_req);
         link_age_counter_[link] = 1;
         // stats_.interarrival_latency.AddValue(clk_ - last_req_clk_);
         last_req_clk_ = clk_;
@@ -416,7 +458,7 @@ bool HMCMemorySystem::InsertReqToLink(HMCRequest *req, int link) {
     }
 }
 
-bool HMCMemorySystem::InsertHMCReq(HMCRequest *req) {
+bool HMCMemorySystem::InsertHMCReq(const HMCRequest &req) {
     // most CPU models does not support simultaneous insertions
     // if you want to actually simulate the multi-link feature
     // then you have to call this function multiple times in 1 cycle
@@ -444,15 +486,15 @@ bool HMCMemorySystem::InsertHMCReq(HMCRequest *req) {
 void HMCMemorySystem::DrainRequests() {
     // drain quad request queue to vaults
     for (int i = 0; i < 4; i++) {
-        if (!quad_req_queues_[i].empty() &&
-            quad_resp_queues_[i].size() < queue_depth_) {
-            HMCRequest *req = quad_req_queues_[i].front();
+        if (!quad_req_queues_[i].Empty() &&
+            quad_resp_queues_[i].Size() < queue_depth_) {
+            HMCRequest *req = quad_req_queues_[i].Front();
             if (req->exit_time <= logic_clk_) {
                 if (ctrls_[req->vault]->WillAcceptTransaction(req->mem_operand,
                                                               req->is_write)) {
                     InsertReqToDRAM(req);
-                    delete (req);
-                    quad_req_queues_[i].erase(quad_req_queues_[i].begin());
+                    req_pool_.Delete(req);
+                    quad_req_queues_[i].Pop();
                 }
             }
         }
@@ -466,19 +508,18 @@ void HMCMemorySystem::DrainRequests() {
     }
 
     // drain requests from link to quad buffers
-    std::vector<int> age_queue = BuildAgeQueue(link_age_counter_);
-    while (!age_queue.empty()) {
-        int src_link = age_queue.front();
-        int dest_quad = link_req_queues_[src_link].front()->quad;
-        if (quad_req_queues_[dest_quad].size() < queue_depth_ &&
+    uint32_t waiting = AgeMask(link_age_counter_);
+    int src_link;
+    while ((src_link = PopOldest(link_age_counter_, waiting)) >= 0) {
+        int dest_quad = link_req_queues_[src_link].Front()->quad;
+        if (quad_req_queues_[dest_quad].Size() < queue_depth_ &&
             quad_busy_[dest_quad] <= 0) {
-            HMCRequest *req = link_req_queues_[src_link].front();
-            link_req_queues_[src_link].erase(
-                link_req_queues_[src_link].begin());
-            quad_req_queues_[dest_quad].push_back(req);
+            HMCRequest *req = link_req_queues_[src_link].Front();
+            link_req_queues_[src_link].Pop();
+            quad_req_queues_[dest_quad].Push(req);
             quad_busy_[dest_quad] = req->flits;
-            req->exit_time = logic_clk_ + req->flits;
-            if (link_req_queues_[src_link].empty()) {
+            req->exit_time = logic_clk_ + LinkCycles(req->flits);
+            if (link_req_queues_[src_link].Empty()) {
                 link_age_counter_[src_link] = 0;
             } else {
                 link_age_counter_[src_link] = 1;
@@ -486,24 +527,28 @@ void HMCMemorySystem::DrainRequests() {
         } else {  // stalled this cycle, update age counter
             link_age_counter_[src_link]++;
         }
-        age_queue.erase(age_queue.begin());
     }
-    age_queue.clear();
 }
 
 void HMCMemorySystem::DrainResponses() {
     // Link resp to CPU
     for (int i = 0; i < links_; i++) {
-        if (!link_resp_queues_[i].empty()) {
-            HMCResponse *resp = link_resp_queues_[i].front();
+        if (!link_resp_queues_[i].Empty()) {
+            HMCResponse *resp = link_resp_queues_[i].Front();
             if (resp->exit_time <= logic_clk_) {
-                if (resp->type == HMCRespType::RD_RS) {
-                    read_callback_(resp->resp_id);
-                } else {
+                bool is_write = resp->type != HMCRespType::RD_RS;
+                if (poll_completions_) {
+                    completions_.Push(Completion{resp->id, resp->tag,
+                                                 resp->resp_id,
+                                                 resp->added_cycle, clk_,
+                                                 is_write});
+                } else if (is_write) {
                     write_callback_(resp->resp_id);
+                } else {
+                    read_callback_(resp->resp_id);
                 }
-                delete (resp);
-                link_resp_queues_[i].erase(link_resp_queues_[i].begin());
+                resp_pool_.Delete(resp);
+                link_resp_queues_[i].Pop();
             }
         }
     }
@@ -516,19 +561,18 @@ void HMCMemorySystem::DrainResponses() {
     }
 
     // drain responses from quad to link buffers
-    auto age_queue = BuildAgeQueue(quad_age_counter_);
-    while (!age_queue.empty()) {
-        int src_quad = age_queue.front();
-        int dest_link = quad_resp_queues_[src_quad].front()->link;
-        if (link_resp_queues_[dest_link].size() < queue_depth_ &&
+    uint32_t waiting = AgeMask(quad_age_counter_);
+    int src_quad;
+    while ((src_quad = PopOldest(quad_age_counter_, waiting)) >= 0) {
+        int dest_link = quad_resp_queues_[src_quad].Front()->link;
+        if (link_resp_queues_[dest_link].Size() < queue_depth_ &&
             link_busy_[dest_link] <= 0) {
-            HMCResponse *resp = quad_resp_queues_[src_quad].front();
-            quad_resp_queues_[src_quad].erase(
-                quad_resp_queues_[src_quad].begin());
-            link_resp_queues_[dest_link].push_back(resp);
+            HMCResponse *resp = quad_resp_queues_[src_quad].Front();
+            quad_resp_queues_[src_quad].Pop();
+            link_resp_queues_[dest_link].Push(resp);
             link_busy_[dest_link] = resp->flits;
-            resp->exit_time = logic_clk_ + resp->flits;
-            if (quad_resp_queues_[src_quad].size() == 0) {
+            resp->exit_time = logic_clk_ + LinkCycles(resp->flits);
+            if (quad_resp_queues_[src_quad].Size() == 0) {
                 quad_age_counter_[src_quad] = 0;
             } else {
                 quad_age_counter_[src_quad] = 1;
@@ -536,23 +580,33 @@ void HMCMemorySystem::DrainResponses() {
         } else {  // stalled this cycle, update age counter
             quad_age_counter_[src_quad]++;
         }
-        age_queue.erase(age_queue.begin());
     }
-    age_queue.clear();
+}
+
+void HMCMemorySystem::LogicClockTick() {
+    DrainResponses();
+    DrainRequests();
+    logic_ps_ += ps_per_logic_;
+    logic_clk_ += 1;
 }
 
 void HMCMemorySystem::DRAMClockTick() {
+    if (config_.event_driven && clk_ < next_vault_clk_) {
+        // nothing can happen this cycle, vaults catch up lazily
+        clk_++;
+        if (clk_ % config_.epoch_period == 0) {
+            PrintEpochStats();
+        }
+        return;
+    }
+
+    SyncControllers();
     for (size_t i = 0; i < ctrls_.size(); i++) {
         // look ahead and return earlier
-        while (true) {
-            auto pair = ctrls_[i]->ReturnDoneTrans(clk_);
-            if (pair.second == 1) {  // write
-                VaultCallback(pair.first);
-            } else if (pair.second == 0) {  // read
-                VaultCallback(pair.first);
-            } else {
-                break;
-            }
+        returned_trans_.clear();
+        ctrls_[i]->ReturnAllDoneTrans(clk_, returned_trans_);
+        for (const auto &trans : returned_trans_) {
+            VaultCallback(trans);
         }
     }
     for (size_t i = 0; i < ctrls_.size(); i++) {
@@ -560,14 +614,69 @@ void HMCMemorySystem::DRAMClockTick() {
     }
     clk_++;
 
+    if (config_.event_driven) {
+        next_vault_clk_ = NextEventCycle();
+    }
+
     if (clk_ % config_.epoch_period == 0) {
         PrintEpochStats();
     }
     return;
 }
 
+uint64_t HMCMemorySystem::NextLogicCycle() const {
+    // packets waiting for arbitration age every cycle, the others only wait
+    // for their exit time
+    uint64_t next_cycle = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < links_; i++) {
+        if (!link_req_queues_[i].Empty()) {
+            return logic_clk_;
+        }
+        if (!link_resp_queues_[i].Empty()) {
+            next_cycle =
+                std::min(next_cycle, link_resp_queues_[i].Front()->exit_time);
+        }
+    }
+    for (size_t i = 0; i < quad_req_queues_.size(); i++) {
+        if (!quad_resp_queues_[i].Empty()) {
+            return logic_clk_;
+        }
+        if (!quad_req_queues_[i].Empty()) {
+            next_cycle =
+                std::min(next_cycle, quad_req_queues_[i].Front()->exit_time);
+        }
+    }
+    return std::max(next_cycle, logic_clk_);
+}
+
+void HMCMemorySystem::SkipIdleLogic(uint64_t ps) {
+    uint64_t edge_clk = (ps + ps_per_logic_ - 1) / ps_per_logic_;
+    if (logic_clk_ >= edge_clk) {
+        return;
+    }
+    uint64_t next_clk = std::min(edge_clk, NextLogicCycle());
+    if (next_clk <= logic_clk_) {
+        return;
+    }
+    // all an idle logic cycle does is drain the busy indicators by 2
+    uint64_t cycles = next_clk - logic_clk_;
+    for (auto busy : {&link_busy_, &quad_busy_}) {
+        for (auto &&i : *busy) {
+            if (i > 0) {
+                uint64_t steps =
+                    std::min(cycles, static_cast<uint64_t>(i + 1) / 2);
+                i -= 2 * static_cast<int>(steps);
+            }
+        }
+    }
+    logic_clk_ = next_clk;
+    logic_ps_ = logic_clk_ * ps_per_logic_;
+}
+
 void HMCMemorySystem::ClockTick() {
-    if (dram_ps_ == logic_ps_) {
+    uint64_t next_dram_ps = dram_ps_ + ps_per_dram_;
+    SkipIdleLogic(dram_ps_);
+    if (logic_ps_ == dram_ps_) {
         DrainResponses();
         DRAMClockTick();
         DrainRequests();
@@ -576,60 +685,115 @@ void HMCMemorySystem::ClockTick() {
     } else {
         DRAMClockTick();
     }
-    while (logic_ps_ < dram_ps_ + ps_per_dram_) {
-        DrainResponses();
-        DrainRequests();
-        logic_ps_ += ps_per_logic_;
-        logic_clk_ += 1;
+    SkipIdleLogic(next_dram_ps);
+    while (logic_ps_ < next_dram_ps) {
+        LogicClockTick();
+        SkipIdleLogic(next_dram_ps);
     }
-    dram_ps_ += ps_per_dram_;
+    dram_ps_ = next_dram_ps;
     return;
 }
 
-std::vector<int> HMCMemorySystem::BuildAgeQueue(std::vector<int> &age_counter) {
-    // return a vector of indices sorted in decending order
-    // meaning that the oldest age link/quad should be processed first
-    std::vector<int> age_queue;
-    int queue_len = age_counter.size();
-    age_queue.reserve(queue_len);
-    int start_pos = logic_clk_ % queue_len;  // round robin start pos
-    for (int i = 0; i < queue_len; i++) {
-        int pos = (i + start_pos) % queue_len;
-        if (age_counter[pos] > 0) {
-            bool is_inserted = false;
-            for (auto it = age_queue.begin(); it != age_queue.end(); it++) {
-                if (age_counter[pos] > *it) {
-                    age_queue.insert(it, pos);
-                    is_inserted = true;
-                    break;
-                }
-            }
-            if (!is_inserted) {
-                age_queue.push_back(pos);
-            }
+void HMCMemorySystem::RunUntil(uint64_t clk) {
+    while (clk_ < clk) {
+        if (!config_.event_driven || clk_ >= next_vault_clk_ ||
+            NextLogicCycle() != std::numeric_limits<uint64_t>::max()) {
+            ClockTick();
+            continue;
+        }
+        // nothing in flight, jump to the next vault event or epoch boundary
+        uint64_t epoch = config_.epoch_period;
+        uint64_t stop = std::min(std::min(clk, next_vault_clk_),
+                                 (clk_ / epoch + 1) * epoch);
+        dram_ps_ += (stop - clk_) * ps_per_dram_;
+        clk_ = stop;
+        SkipIdleLogic(dram_ps_);
+        if (clk_ % epoch == 0) {
+            PrintEpochStats();
+        }
+    }
+}
+
+void HMCMemorySystem::Drain() {
+    while (Outstanding() > 0) {
+        // with the crossbar empty whatever is left sits in the vaults
+        uint64_t clk = clk_ + 1;
+        if (config_.event_driven &&
+            NextLogicCycle() == std::numeric_limits<uint64_t>::max()) {
+            clk = std::max(clk, next_vault_clk_);
         }
+        RunUntil(clk);
     }
-    return age_queue;
+}
+
+uint64_t HMCMemorySystem::Outstanding() const {
+    // packets in the links, crossbar and vaults
+    uint64_t outstanding = 0;
+    for (int i = 0; i < links_; i++) {
+        outstanding += link_req_queues_[i].Size() + link_resp_queues_[i].Size();
+    }
+    for (size_t i = 0; i < quad_req_queues_.size(); i++) {
+        outstanding += quad_req_queues_[i].Size() + quad_resp_queues_[i].Size();
+    }
+    for (size_t i = 0; i < ctrls_.size(); i++) {
+        outstanding += ctrls_[i]->Outstanding();
+    }
+    return outstanding;
+}
+
+uint32_t HMCMemorySystem::AgeMask(const std::vector<int> &age_counter) const {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < age_counter.size(); i++) {
+        if (age_counter[i] > 0) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+int HMCMemorySystem::PopOldest(const std::vector<int> &age_counter,
+                               uint32_t &mask) const {
+    if (mask == 0) {
+        return -1;
+    }
+    // rotate the round robin start pos to bit 0, walking the set bits from
+    // the lowest then visits them in round robin order and the first of the
+    // oldest wins
+    int len = static_cast<int>(age_counter.size());
+    int start_pos = logic_clk_ % len;
+    uint64_t wide = mask;
+    uint64_t rotated = (wide >> start_pos) | (wide << (len - start_pos));
+    rotated &= (1ull << len) - 1;
+    int oldest = -1;
+    while (rotated != 0) {
+        int pos = (__builtin_ctzll(rotated) + start_pos) % len;
+        if (oldest < 0 || age_counter[pos] > age_counter[oldest]) {
+            oldest = pos;
+        }
+        rotated &= rotated - 1;
+    }
+    mask &= ~(1u << oldest);
+    return oldest;
 }
 
 void HMCMemorySystem::InsertReqToDRAM(HMCRequest *req) {
     Transaction trans(req->mem_operand, req->is_write);
+    trans.id = req->id;
+    // the vault hands the transaction back as is, so it can carry the
+    // response along instead of the caller's tag (which the response has)
+    trans.tag = reinterpret_cast<uintptr_t>(req->resp);
+    ctrls_[req->vault]->FastForward(clk_);
     ctrls_[req->vault]->AddTransaction(trans);
+    next_vault_clk_ = clk_;
     return;
 }
 
-void HMCMemorySystem::VaultCallback(uint64_t req_id) {
-    // we will use hex addr as the req_id and use a multimap to lookup the
-    // requests the vaults cannot directly talk to the CPU so this callback will
-    // be passed to the vaults and is responsible to put the responses back to
-    // response queues
-
-    auto it = resp_lookup_table_.find(req_id);
-    HMCResponse *resp = it->second;
+void HMCMemorySystem::VaultCallback(const Transaction &trans) {
+    // the vaults cannot directly talk to the CPU so this callback is
+    // responsible to put the responses back to response queues
+    HMCResponse *resp = reinterpret_cast<HMCResponse *>(trans.tag);
     // all data from dram received, put packet in xbar and return
-    resp_lookup_table_.erase(it);
-    // put it in xbar
-    quad_resp_queues_[resp->quad].push_back(resp);
+    quad_resp_queues_[resp->quad].Push(resp);
     quad_age_counter_[resp->quad] = 1;
     return;
 }
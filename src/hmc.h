@@ -2,10 +2,11 @@
 #define __HMC_H
 
 #include <functional>
-#include <map>
 #include <vector>
 
 #include "dram_system.h"
+#include "object_pool.h"
+#include "ring_buffer.h"
 
 namespace dramsim3 {
 
@@ -76,11 +77,16 @@ enum class HMCRespType { NONE, RD_RS, WR_RS, ERR, SIZE };
 // for future use
 enum class HMCLinkType { HOST_TO_DEV, DEV_TO_DEV, SIZE };
 
+class HMCResponse;
+
 class HMCRequest {
    public:
     HMCRequest(HMCReqType req_type, uint64_t hex_addr, int vault);
     HMCReqType type;
     uint64_t mem_operand;
+    // id is assigned once a link takes the request, tag is the caller's
+    uint64_t id;
+    uint64_t tag;
     int link;
     int quad;
     int vault;
@@ -88,12 +94,19 @@ class HMCRequest {
     bool is_write;
     // this exit_time is the time to exit xbar to vaults
     uint64_t exit_time;
+    // sent back once the vault is done, set when a link takes the request
+    HMCResponse* resp;
 };
 
 class HMCResponse {
    public:
-    HMCResponse(uint64_t id, HMCReqType reqtype, int dest_link, int src_quad);
+    HMCResponse(const HMCRequest& req, int dest_link);
+    // address of the request
     uint64_t resp_id;
+    // of the request, for the completion record
+    uint64_t id;
+    uint64_t tag;
+    uint64_t added_cycle;
     HMCRespType type;
     int link;
     int quad;
@@ -108,28 +121,56 @@ class HMCMemorySystem : public BaseDRAMSystem {
                     std::function<void(uint64_t)> read_callback,
                     std::function<void(uint64_t)> write_callback);
     ~HMCMemorySystem();
-    // assuming there are 2 clock domains one for logic die one for DRAM
-    // we can unify them as one but then we'll have to convert all the
-    // slow dram time units to faster logic units...
+    // one DRAM cycle, i.e. every event of the link, logic and vault clock
+    // domains up to the next DRAM edge, see the scheduler below
     void ClockTick() override;
+    // skips whole stretches of cycles while nothing is in flight
+    void RunUntil(uint64_t clk) override;
+    void Drain() override;
+    uint64_t Outstanding() const override;
+    // the link, crossbar and vault request queues aren't serialized (yet)
+    void Checkpoint(CheckpointWriter& out) override;
+    void Restore(CheckpointReader& in) override;
 
     // had to have 3 insert interfaces cuz HMC is so different...
     bool WillAcceptTransaction(uint64_t hex_addr, bool is_write) const override;
-    bool AddTransaction(uint64_t hex_addr, bool is_write) override;
-    bool InsertReqToLink(HMCRequest* req, int link);
-    bool InsertHMCReq(HMCRequest* req);
+    bool AddTransaction(uint64_t hex_addr, bool is_write,
+                        uint64_t tag) override;
+    // req is copied if a link takes it
+    bool InsertHMCReq(const HMCRequest& req);
 
    private:
-    uint64_t logic_clk_, ps_per_dram_, ps_per_logic_, logic_ps_, dram_ps_;
+    // Discrete event scheduler on a picosecond timebase. The vaults run on
+    // DRAM edges (every ps_per_dram_) and the crossbar on logic edges
+    // (every ps_per_logic_, logic_ps_ == logic_clk_ * ps_per_logic_), a
+    // logic edge that falls on a DRAM edge drains the responses before and
+    // the requests after the vaults tick. Links serialize a flit every
+    // ps_per_flit_, counted in logic cycles by LinkCycles(). Components only
+    // wake up when they have something to do: the crossbar through
+    // NextLogicCycle(), the vaults through next_vault_clk_ in event driven
+    // mode, all other edges are skipped in O(1).
+    uint64_t logic_clk_, ps_per_dram_, ps_per_logic_, ps_per_flit_, logic_ps_,
+        dram_ps_;
+    uint64_t next_vault_clk_;
 
     void SetClockRatio();
+    uint64_t LinkCycles(int flits) const;
+    // earliest logic cycle the crossbar can move a packet in, max if empty
+    uint64_t NextLogicCycle() const;
+    // skip idle logic edges, stopping at the first one at or after ps
+    void SkipIdleLogic(uint64_t ps);
+    void LogicClockTick();
     void DRAMClockTick();
     void DrainRequests();
     void DrainResponses();
+    bool InsertReqToLink(const HMCRequest& req, int link);
     void InsertReqToDRAM(HMCRequest* req);
-    void VaultCallback(uint64_t req_id);
-    std::vector<int> BuildAgeQueue(std::vector<int>& age_counter);
-    void XbarArbitrate();
+    void VaultCallback(const Transaction& trans);
+    // crossbar arbitration: AgeMask() has a bit for every link/quad with a
+    // packet waiting, PopOldest() takes the oldest one out of it (ties go
+    // round robin), -1 once none is left
+    uint32_t AgeMask(const std::vector<int>& age_counter) const;
+    int PopOldest(const std::vector<int>& age_counter, uint32_t& mask) const;
     inline void IterateNextLink();
 
     int next_link_;
@@ -139,14 +180,18 @@ class HMCMemorySystem : public BaseDRAMSystem {
     // number of flits xbar can process per logic cycle
     const int xbar_bandwidth_ = 2;
 
-    // had to use a multimap because the controller callback return hex addr
-    // instead of unique id
-    std::multimap<uint64_t, HMCResponse*> resp_lookup_table_;
-    // these are essentially input/output buffers for xbars
-    std::vector<std::vector<HMCRequest*>> link_req_queues_;
-    std::vector<std::vector<HMCResponse*>> link_resp_queues_;
-    std::vector<std::vector<HMCRequest*>> quad_req_queues_;
-    std::vector<std::vector<HMCResponse*>> quad_resp_queues_;
+    // every packet in flight lives in these
+    ObjectPool<HMCRequest> req_pool_;
+    ObjectPool<HMCResponse> resp_pool_;
+    // scratch buffer for completions returned by the vaults
+    std::vector<Transaction> returned_trans_;
+    // these are essentially input/output buffers for xbars, all of them hold
+    // at most queue_depth_ packets but the quad response queues, which take
+    // whatever the vaults return
+    std::vector<RingBuffer<HMCRequest*>> link_req_queues_;
+    std::vector<RingBuffer<HMCResponse*>> link_resp_queues_;
+    std::vector<RingBuffer<HMCRequest*>> quad_req_queues_;
+    std::vector<RingBuffer<HMCResponse*>> quad_resp_queues_;
 
     // input/output busy indicators, since each packet could be several
     // flits, as long as this != 0 then they're busy
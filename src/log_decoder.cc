@@ -0,0 +1,21 @@
+#include <iostream>
+#include <string>
+#include "logger.h"
+
+// Turns the binary log.bin written by Logger back into log.txt, issue.txt
+// and return.txt
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <log.bin> [output_dir]\n";
+        std::cerr << "Example: " << argv[0] << " output/log.bin output\n";
+        return 1;
+    }
+
+    std::string log_file = argv[1];
+    std::string output_dir = argc == 3 ? argv[2] : "output";
+    if (!dramsim3::DecodeBinaryLog(log_file, output_dir)) {
+        return 1;
+    }
+    std::cout << "[Decoder] Logs written to: " << output_dir << "\n";
+    return 0;
+}
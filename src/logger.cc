@@ -1,32 +1,133 @@
 #include "logger.h"
 
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <vector>
+
 namespace dramsim3 {
 
-// Static members
-std::ofstream Logger::log_all_;
-std::ofstream Logger::log_issue_;
-std::ofstream Logger::log_return_;
+namespace {
+const char kLogMagic[8] = {'D', 'S', '3', 'L', 'O', 'G', '1', '\0'};
+const size_t kRingCapacity = 1 << 16;
+const size_t kWriteBatch = 4096;
+
+std::string CommandName(int type) {
+    switch (static_cast<CommandType>(type)) {
+        case CommandType::READ: return "READ";
+        case CommandType::READ_PRECHARGE: return "READ_PRECHARGE";
+        case CommandType::WRITE: return "WRITE";
+        case CommandType::WRITE_PRECHARGE: return "WRITE_PRECHARGE";
+        case CommandType::ACTIVATE: return "ACTIVATE";
+        case CommandType::PRECHARGE: return "PRECHARGE";
+        case CommandType::REFRESH_BANK: return "REFRESH_BANK";
+        case CommandType::REFRESH: return "REFRESH";
+        case CommandType::SREF_ENTER: return "SREF_ENTER";
+        case CommandType::SREF_EXIT: return "SREF_EXIT";
+        default: return "INVALID";
+    }
+}
+
+void EmitCycleIfNeeded(std::ostream& out, uint64_t cycle,
+                       std::optional<uint64_t>& last_cycle) {
+    if (!last_cycle.has_value() || last_cycle.value() != cycle) {
+        out << "[+] " << std::setw(5) << std::left << cycle;
+        last_cycle = cycle;
+    } else {
+        out << std::setw(8) << " ";
+    }
+}
+}  // namespace
+
+LogRing::LogRing(size_t capacity)
+    : cells_(new Cell[capacity]),
+      mask_(capacity - 1),
+      enqueue_pos_(0),
+      dequeue_pos_(0) {
+    for (size_t i = 0; i < capacity; i++) {
+        cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+void LogRing::Push(const LogRecord& record) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[pos & mask_];
+        size_t seq = cell.seq.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed)) {
+                cell.record = record;
+                cell.seq.store(pos + 1, std::memory_order_release);
+                return;
+            }
+        } else if (diff < 0) {
+            // full, wait for the writer thread to catch up
+            std::this_thread::yield();
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
 
-uint64_t Logger::current_cycle_ = 0;
-std::optional<uint64_t> Logger::last_log_cycle_ = std::nullopt;
-std::optional<uint64_t> Logger::last_issue_cycle_ = std::nullopt;
-std::optional<uint64_t> Logger::last_return_cycle_ = std::nullopt;
+bool LogRing::Pop(LogRecord& record) {
+    Cell& cell = cells_[dequeue_pos_ & mask_];
+    size_t seq = cell.seq.load(std::memory_order_acquire);
+    if (seq != dequeue_pos_ + 1) {
+        return false;
+    }
+    record = cell.record;
+    cell.seq.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+    dequeue_pos_++;
+    return true;
+}
 
-void Logger::Init(const std::string& dir) {
+// Static members
+std::atomic<unsigned> Logger::levels_(LOG_NONE);
+std::unique_ptr<LogRing> Logger::ring_;
+std::FILE* Logger::log_file_ = nullptr;
+std::thread Logger::writer_;
+std::atomic<bool> Logger::stop_writer_(false);
+thread_local std::vector<LogRecord>* Logger::capture_ = nullptr;
+
+void Logger::Init(const std::string& dir, unsigned levels) {
     std::filesystem::create_directories(dir);
-    log_all_.open(dir + "/log.txt");
-    log_issue_.open(dir + "/issue.txt");
-    log_return_.open(dir + "/return.txt");
+    std::string log_name = dir + "/log.bin";
+    log_file_ = std::fopen(log_name.c_str(), "wb");
+    if (!log_file_) {
+        std::cerr << "Can't open " << log_name << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    uint32_t record_size = sizeof(LogRecord);
+    std::fwrite(kLogMagic, sizeof(kLogMagic), 1, log_file_);
+    std::fwrite(&record_size, sizeof(record_size), 1, log_file_);
+
+    ring_.reset(new LogRing(kRingCapacity));
+    stop_writer_.store(false);
+    writer_ = std::thread(WriterLoop);
+    SetLevels(levels);
 }
 
 void Logger::Close() {
-    log_all_.close();
-    log_issue_.close();
-    log_return_.close();
+    SetLevels(LOG_NONE);
+    if (!writer_.joinable()) {
+        return;
+    }
+    stop_writer_.store(true);
+    writer_.join();
+    std::fclose(log_file_);
+    log_file_ = nullptr;
+    ring_.reset();
 }
 
 void Logger::PrintCycle(uint64_t clk) {
-    current_cycle_ = clk;
     if (g_print_cycle) {
         std::ostringstream oss;
         oss << "[+] " << std::setw(5) << std::left << clk;
@@ -34,68 +135,133 @@ void Logger::PrintCycle(uint64_t clk) {
     }
 }
 
-void Logger::EmitCycleIfNeeded(std::ostream& out, std::optional<uint64_t>& last_cycle) {
-    if (!last_cycle.has_value() || last_cycle.value() != current_cycle_) {
-        out << "[+] " << std::setw(5) << std::left << current_cycle_;
-        last_cycle = current_cycle_;
+void Logger::LogIssue(uint64_t clk, const Command& cmd) {
+    LogRecord record{};
+    record.cycle = clk;
+    record.hex_addr = cmd.hex_addr;
+    record.channel = cmd.addr.channel;
+    record.bankgroup = cmd.addr.bankgroup;
+    record.bank = cmd.addr.bank;
+    record.row = cmd.addr.row;
+    record.column = cmd.addr.column;
+    record.kind = LOG_ISSUE;
+    record.type = static_cast<uint8_t>(cmd.cmd_type);
+    Append(record);
+}
+
+void Logger::LogReturn(uint64_t clk, const Transaction& trans) {
+    LogRecord record{};
+    record.cycle = clk;
+    record.hex_addr = trans.addr;
+    record.added_cycle = trans.added_cycle;
+    record.complete_cycle = trans.complete_cycle;
+    record.kind = LOG_RETURN;
+    record.type = trans.is_write;
+    Append(record);
+}
+
+void Logger::Append(const LogRecord& record) {
+    if (capture_) {
+        capture_->push_back(record);
     } else {
-        out << std::setw(8) << " "; // 공백 맞추기
+        Write(record);
     }
 }
 
-
-void Logger::PrintIssue(uint64_t clk, const Command& cmd) {
-    std::ostringstream line;
-    std::string cmd_str;
-
-    switch (cmd.cmd_type) {
-        case CommandType::READ: cmd_str = "READ"; break;
-        case CommandType::READ_PRECHARGE: cmd_str = "READ_PRECHARGE"; break;
-        case CommandType::WRITE: cmd_str = "WRITE"; break;
-        case CommandType::WRITE_PRECHARGE: cmd_str = "WRITE_PRECHARGE"; break;
-        case CommandType::ACTIVATE: cmd_str = "ACTIVATE"; break;
-        case CommandType::PRECHARGE: cmd_str = "PRECHARGE"; break;
-        case CommandType::REFRESH_BANK: cmd_str = "REFRESH_BANK"; break;
-        case CommandType::REFRESH: cmd_str = "REFRESH"; break;
-        case CommandType::SREF_ENTER: cmd_str = "SREF_ENTER"; break;
-        case CommandType::SREF_EXIT: cmd_str = "SREF_EXIT"; break;
-        default: cmd_str = "INVALID";
+void Logger::Write(const LogRecord& record) {
+    // levels may be switched on without Init, there is nowhere to write then
+    if (ring_) {
+        ring_->Push(record);
     }
+    if (record.kind == LOG_ISSUE && g_print_issue) {
+        std::cout << "\033[32m" << FormatRecord(record) << "\033[0m";
+    } else if (record.kind == LOG_RETURN && g_print_return) {
+        std::cout << "\033[34m" << FormatRecord(record) << "\033[0m";
+    }
+}
 
-    line << "\t\t[*] (Issue) "
-         << " Type: " << std::left << std::setw(15) << cmd_str
-         << " | Addr: 0x" << std::right << std::hex << std::setw(8) << std::setfill('0') << cmd.hex_addr << std::dec
-        << " -> Channel: " << std::setw(2) << std::setfill(' ') << cmd.addr.channel
-        << ", BG: " << std::setw(1) << cmd.addr.bankgroup
-        << ", Bank: " << std::setw(1) << cmd.addr.bank
-        << ", Row: " << std::setw(5) << cmd.addr.row
-        << ", Col: " << std::setw(2) << cmd.addr.column;
-
-    std::string log_line = line.str() + "\n";
-
-    if (g_print_issue) std::cout << "\033[32m" << log_line << "\033[0m";
-    EmitCycleIfNeeded(log_all_, last_log_cycle_);
-    EmitCycleIfNeeded(log_issue_, last_issue_cycle_);
-    log_all_ << log_line;
-    log_issue_ << log_line;
+void Logger::WriterLoop() {
+    std::vector<LogRecord> batch(kWriteBatch);
+    while (true) {
+        // read the flag first so nothing pushed before Close is missed
+        bool stopping = stop_writer_.load();
+        size_t count = 0;
+        while (count < kWriteBatch && ring_->Pop(batch[count])) {
+            count++;
+        }
+        if (count > 0) {
+            std::fwrite(batch.data(), sizeof(LogRecord), count, log_file_);
+        } else if (stopping) {
+            break;
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    std::fflush(log_file_);
 }
 
-void Logger::PrintReturn(uint64_t clk, const Transaction& trans) {
+std::string Logger::FormatRecord(const LogRecord& record) {
     std::ostringstream line;
-    line << "\t\t[=] (Return)"
-         << " Type: " << std::left << std::setw(15) << std::setfill(' ') << (trans.is_write ? "WRITE" : "READ")
-         << " | Addr: 0x" << std::right << std::hex << std::setw(8) << std::setfill('0') << trans.addr << std::dec
-         << " | Added: " << std::setw(5) << std::setfill(' ') << trans.added_cycle
-         << ", Done: " << std::setw(5) << std::setfill(' ') << trans.complete_cycle
-         << ", Latency: " <<  std::setw(5) << std::setfill(' ') << (trans.complete_cycle - trans.added_cycle);
-
-    std::string log_line = line.str() + "\n";
-
-    if (g_print_return) std::cout << "\033[34m" << log_line << "\033[0m";
-    EmitCycleIfNeeded(log_all_, last_log_cycle_);
-    EmitCycleIfNeeded(log_return_, last_return_cycle_);
-    log_all_ << log_line;
-    log_return_ << log_line;
+    if (record.kind == LOG_ISSUE) {
+        line << "\t\t[*] (Issue) "
+             << " Type: " << std::left << std::setw(15)
+             << CommandName(record.type) << " | Addr: 0x" << std::right
+             << std::hex << std::setw(8) << std::setfill('0')
+             << record.hex_addr << std::dec
+             << " -> Channel: " << std::setw(2) << std::setfill(' ')
+             << record.channel << ", BG: " << std::setw(1) << record.bankgroup
+             << ", Bank: " << std::setw(1) << record.bank
+             << ", Row: " << std::setw(5) << record.row
+             << ", Col: " << std::setw(2) << record.column;
+    } else {
+        line << "\t\t[=] (Return)"
+             << " Type: " << std::left << std::setw(15) << std::setfill(' ')
+             << (record.type ? "WRITE" : "READ") << " | Addr: 0x"
+             << std::right << std::hex << std::setw(8) << std::setfill('0')
+             << record.hex_addr << std::dec
+             << " | Added: " << std::setw(5) << std::setfill(' ')
+             << record.added_cycle << ", Done: " << std::setw(5)
+             << std::setfill(' ') << record.complete_cycle
+             << ", Latency: " << std::setw(5) << std::setfill(' ')
+             << (record.complete_cycle - record.added_cycle);
+    }
+    line << "\n";
+    return line.str();
+}
+
+bool DecodeBinaryLog(const std::string& log_file, const std::string& dir) {
+    std::ifstream in(log_file, std::ios::binary);
+    char magic[sizeof(kLogMagic)];
+    uint32_t record_size = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&record_size), sizeof(record_size));
+    if (!in || std::memcmp(magic, kLogMagic, sizeof(magic)) != 0 ||
+        record_size != sizeof(LogRecord)) {
+        std::cerr << log_file << " is not a binary log of this build"
+                  << std::endl;
+        return false;
+    }
+
+    std::filesystem::create_directories(dir);
+    std::ofstream log_all(dir + "/log.txt");
+    std::ofstream log_issue(dir + "/issue.txt");
+    std::ofstream log_return(dir + "/return.txt");
+    std::optional<uint64_t> last_log_cycle, last_issue_cycle,
+        last_return_cycle;
+    LogRecord record;
+    while (in.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        std::string line = Logger::FormatRecord(record);
+        EmitCycleIfNeeded(log_all, record.cycle, last_log_cycle);
+        log_all << line;
+        if (record.kind == LOG_ISSUE) {
+            EmitCycleIfNeeded(log_issue, record.cycle, last_issue_cycle);
+            log_issue << line;
+        } else {
+            EmitCycleIfNeeded(log_return, record.cycle, last_return_cycle);
+            log_return << line;
+        }
+    }
+    return true;
 }
 
 }  // namespace dramsim3
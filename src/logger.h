@@ -1,14 +1,13 @@
 // logger.h
 #pragma once
 
-#include <fstream>
-#include <string>
+#include <atomic>
 #include <cstdint>
-#include <iostream>
-#include <iomanip>
-#include <sstream>
-#include <filesystem>
-#include <optional>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 #include "common.h"
 
 namespace dramsim3 {
@@ -18,26 +17,106 @@ extern bool g_print_cycle;
 extern bool g_print_issue;
 extern bool g_print_return;
 
+// Log levels, a bit mask that can be changed while running. Building
+// without PRINT_ISSUE_LOG / PRINT_RETURN_LOG compiles the matching calls out.
+enum LogLevel : unsigned {
+    LOG_NONE = 0,
+    LOG_ISSUE = 1 << 0,
+    LOG_RETURN = 1 << 1,
+    LOG_ALL = LOG_ISSUE | LOG_RETURN
+};
+
+// One fixed size record per logged event, written as is to log.bin
+struct LogRecord {
+    uint64_t cycle;  // of the channel when it happened, heads blocks of lines
+    uint64_t hex_addr;
+    uint64_t added_cycle;     // return only
+    uint64_t complete_cycle;  // return only
+    int32_t channel;          // issue only, as are the fields below
+    int32_t bankgroup;
+    int32_t bank;
+    int32_t row;
+    int32_t column;
+    uint8_t kind;  // LOG_ISSUE or LOG_RETURN
+    uint8_t type;  // CommandType for an issue, is_write for a return
+};
+
+// Bounded multi producer single consumer ring of records, after D. Vyukov's
+// bounded queue: each cell carries a sequence number telling producers and
+// the consumer whose turn it is, so channels on different threads never
+// take a lock.
+class LogRing {
+   public:
+    explicit LogRing(size_t capacity);
+    // spins while the ring is full, records are never dropped
+    void Push(const LogRecord& record);
+    bool Pop(LogRecord& record);
+
+   private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        LogRecord record;
+    };
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) size_t dequeue_pos_;
+};
+
+// Events are appended to a ring buffer and a background thread writes them
+// to <dir>/log.bin. DecodeBinaryLog (or the decode_log tool) turns that into
+// the readable log.txt, issue.txt and return.txt.
 class Logger {
    public:
-    static void Init(const std::string& dir = "output/");
+    static void Init(const std::string& dir = "output/",
+                     unsigned levels = LOG_ALL);
+    static void SetLevels(unsigned levels) {
+        levels_.store(levels, std::memory_order_relaxed);
+    }
+    static unsigned Levels() {
+        return levels_.load(std::memory_order_relaxed);
+    }
     static void PrintCycle(uint64_t clk);
-    static void PrintIssue(uint64_t clk, const Command& cmd);
-    static void PrintReturn(uint64_t clk, const Transaction& trans);
+    static void PrintIssue(uint64_t clk, const Command& cmd) {
+#ifdef PRINT_ISSUE_LOG
+        if (Levels() & LOG_ISSUE) {
+            LogIssue(clk, cmd);
+        }
+#endif  // PRINT_ISSUE_LOG
+    }
+    static void PrintReturn(uint64_t clk, const Transaction& trans) {
+#ifdef PRINT_RETURN_LOG
+        if (Levels() & LOG_RETURN) {
+            LogReturn(clk, trans);
+        }
+#endif  // PRINT_RETURN_LOG
+    }
     static void Close();
 
+    // Records of the calling thread go to buffer instead of the log until
+    // it is called with nullptr, Write() logs them later. Lets channels run
+    // on worker threads and still be logged in the serial order.
+    static void Capture(std::vector<LogRecord>* buffer) { capture_ = buffer; }
+    static void Write(const LogRecord& record);
+
+    // the readable line of a record, without the cycle column
+    static std::string FormatRecord(const LogRecord& record);
+
    private:
-    static std::ofstream log_all_;
-    static std::ofstream log_issue_;
-    static std::ofstream log_return_;
-    
-    static uint64_t current_cycle_;
-    static std::optional<uint64_t> last_log_cycle_;
-    static std::optional<uint64_t> last_issue_cycle_;
-    static std::optional<uint64_t> last_return_cycle_;
-
-    
-    static void EmitCycleIfNeeded(std::ostream& out, std::optional<uint64_t>& last_cycle);
+    static std::atomic<unsigned> levels_;
+    static std::unique_ptr<LogRing> ring_;
+    static std::FILE* log_file_;
+    static std::thread writer_;
+    static std::atomic<bool> stop_writer_;
+    static thread_local std::vector<LogRecord>* capture_;
+
+    static void LogIssue(uint64_t clk, const Command& cmd);
+    static void LogReturn(uint64_t clk, const Transaction& trans);
+    static void Append(const LogRecord& record);
+    static void WriterLoop();
 };
 
+// Writes log.txt, issue.txt and return.txt into dir from a log.bin
+bool DecodeBinaryLog(const std::string& log_file, const std::string& dir);
+
 }  // namespace dramsim3
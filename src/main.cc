@@ -4,180 +4,174 @@
 #include <string>
 #include <functional>
 #include <deque>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
 #include "memory_system.h"
+#include "sampler.h"
 #include "common.h"
 #include "logger.h" 
+#include "spsc_ring.h"
+#include "trace_file.h"
+#include "thread_pool.h"
+#include "trace_preprocess.h"
 
 using namespace dramsim3;
 
-std::vector<Transaction> LoadTraceFile(const std::string& trace_file) {
-    std::vector<Transaction> trace;
-    std::ifstream fin(trace_file);
-    if (!fin) {
-        throw std::runtime_error("Failed to open trace file: " + trace_file);
+// Trace requests on their way from the reader thread to the simulation,
+// one ring per queue. For every window the reader also publishes where each
+// queue's part of it ends, counted in requests since the start of the trace,
+// an idle queue gets an end all the same.
+struct TraceStream {
+    TraceStream(int num_queues, size_t ring_size)
+        : rings(num_queues), window_ends(num_queues), eof(false) {
+        for (int q = 0; q < num_queues; ++q) {
+            rings[q].reset(new SPSCRing<Transaction>(ring_size));
+            window_ends[q].reset(new SPSCRing<uint64_t>(64));
+        }
     }
+    int NumQueues() const { return static_cast<int>(rings.size()); }
+    std::vector<std::unique_ptr<SPSCRing<Transaction>>> rings;
+    std::vector<std::unique_ptr<SPSCRing<uint64_t>>> window_ends;
+    std::atomic<bool> eof;  // every window end was pushed
+};
+
+// Reader thread: reads the trace window_size requests at a time, orders each
+// window with the preprocessor and feeds the per queue rings. A new window
+// is only read once the previous one is all in the rings, so memory stays at
+// about one window. Windows at least as long as the trace order it exactly
+// as a whole.
+void StreamTrace(TraceReader& reader, TracePreprocessor& preprocessor,
+                 TraceStream& stream, size_t window_size) {
+    int num_queues = stream.NumQueues();
+    std::vector<std::deque<Transaction>> pending(num_queues);
+    std::vector<uint64_t> ends(num_queues, 0);
+    std::vector<Transaction> window;
+    while (true) {
+        bool all_pending_empty = true;
+        for (int q = 0; q < num_queues; ++q) {
+            all_pending_empty &= pending[q].empty();
+        }
+        if (all_pending_empty) {
+            window.clear();
+            if (reader.Read(window, window_size) == 0) {
+                stream.eof.store(true);
+                break;
+            }
+            preprocessor.Process(window, pending);
+            for (int q = 0; q < num_queues; ++q) {
+                ends[q] += pending[q].size();
+                while (!stream.window_ends[q]->TryPush(ends[q])) {
+                    // far ahead of the simulation already
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+        }
 
-    std::string rw;
-    uint64_t addr;
-    while (fin >> std::hex >> addr >> rw) {
-        trace.emplace_back(addr, rw == "W");
+        // round robin so a full ring never holds the other queues back
+        bool pushed = false;
+        for (int q = 0; q < num_queues; ++q) {
+            while (!pending[q].empty() &&
+                   stream.rings[q]->TryPush(pending[q].front())) {
+                pending[q].pop_front();
+                pushed = true;
+            }
+        }
+        if (!pushed) {
+            // the rings are full, give the simulation time to drain them
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
     }
-
-    return trace;
 }
 
-// Channel Distribute
-void PreprocessTrace(const std::vector<Transaction>& input_trace,
-                     std::deque<Transaction> channel_queues[8],
-                     const MemorySystem* mem) {
-    std::deque<Transaction> pseudo_queues[16];
-
-    // 1. 모든 트랜잭션을 pseudo channel 별로 분류
-    for (const auto& t : input_trace) {
-        int pseudo_ch = mem->GetDramSystem()->GetChannel(t.addr);
-        assert(pseudo_ch >= 0 && pseudo_ch < 16);
-        pseudo_queues[pseudo_ch].push_back(t);
-    }
-
-    for (int i = 0; i < 16; ++i) {
-        auto& dq = pseudo_queues[i];
-
-        // deque -> vector로 복사 후 정렬
-        std::vector<Transaction> sorted(dq.begin(), dq.end());
-        std::sort(sorted.begin(), sorted.end(), [](const Transaction& a, const Transaction& b) {
-            return a.addr < b.addr;
-        });
-
-        // 정렬된 결과를 다시 deque로
-        dq = std::deque<Transaction>(sorted.begin(), sorted.end());
+// Moves every queue on to its part of the next window, false once the trace
+// is done. Waits for the reader thread rather than guessing, so the
+// simulation does not depend on how fast the trace is read.
+bool NextWindow(TraceStream& stream, std::vector<uint64_t>& limits) {
+    for (int q = 0; q < stream.NumQueues(); ++q) {
+        auto& ends = *stream.window_ends[q];
+        uint64_t* end = ends.Front();
+        while (!end && !stream.eof.load()) {
+            std::this_thread::yield();
+            end = ends.Front();
+        }
+        // every end was pushed before eof was set
+        end = end ? end : ends.Front();
+        if (!end) {
+            return false;
+        }
+        limits[q] = *end;
+        ends.Pop();
     }
+    return true;
+}
 
-    // 2. 2개씩 묶어서 channel queue로 번갈아가며 넣기
-    for (int ch = 0; ch < 8; ++ch) {
-        auto& q0 = pseudo_queues[2 * ch];
-        auto& q1 = pseudo_queues[2 * ch + 1];
-        auto& out = channel_queues[ch];
-
-        bool toggle = true;
-        while (!q0.empty() || !q1.empty()) {
-            if (toggle && !q0.empty()) {
-                out.push_back(q0.front()); q0.pop_front();
-            } else if (!toggle && !q1.empty()) {
-                out.push_back(q1.front()); q1.pop_front();
-            }
-            toggle = !toggle;
-        }
+// Next request of a queue that has one left in the current window
+Transaction* NextTransaction(TraceStream& stream, int q) {
+    auto& ring = *stream.rings[q];
+    Transaction* t = ring.Front();
+    while (!t) {
+        std::this_thread::yield();
+        t = ring.Front();
     }
+    return t;
 }
 
-// // Row Locality, Bank.Bankgroup Parallelism
-// void PreprocessTrace(const std::vector<Transaction>& input_trace,
-//                      std::deque<Transaction> channel_queues[8],
-//                      const MemorySystem* mem) {
-//     auto* config = mem->GetConfig();
-
-//     // Step 1: 분류 hbm_map[channel][bg][ba]
-//     std::map<int, std::map<int, std::map<int, std::vector<Transaction>>>> hbm_map;
-//     for (const auto& t : input_trace) {
-//         Address addr = config->AddressMapping(t.addr);
-//         hbm_map[addr.channel][addr.bankgroup][addr.bank].push_back(t);
-//     }
-
-//     std::deque<Transaction> pseudo_queues[16];
-//     // Step 2: 각 pseudo channel마다 bankgroup_queues[4] 준비
-//     for (int ch = 0; ch < 16; ++ch) {
-//         std::deque<Transaction> bankgroup_queues[4]; // BG 0~3
-
-//         for (int bg = 0; bg < 4; ++bg) {
-//             std::deque<Transaction> bank_queues[4]; // BA 0~3
-
-//             for (int ba = 0; ba < 4; ++ba) {
-//                 auto& txns = hbm_map[ch][bg][ba];
-
-//                 // addr 기준 정렬 → row locality 확보
-//                 std::sort(txns.begin(), txns.end(), [](const Transaction& a, const Transaction& b) {
-//                     return a.addr < b.addr;
-//                 });
-
-//                 for (const auto& t : txns) {
-//                     bank_queues[ba].push_back(t);
-//                 }
-//             }
-
-//             // bank round-robin → 하나의 BG 큐로
-//             bool progress = true;
-//             while (progress) {
-//                 progress = false;
-//                 for (int ba = 0; ba < 4; ++ba) {
-//                     if (!bank_queues[ba].empty()) {
-//                         bankgroup_queues[bg].push_back(bank_queues[ba].front());
-//                         bank_queues[ba].pop_front();
-//                         progress = true;
-//                     }
-//                 }
-//             }
-//         }
-//         // Step 3: bankgroup 0~3 순서로 round-robin → pseudo queue에 push
-//         size_t index[4] = {0};
-//         bool progress = true;
-//         while (progress) {
-//             progress = false;
-//             for (int bg = 0; bg < 4; ++bg) {
-//                 if (index[bg] < bankgroup_queues[bg].size()) {
-//                     pseudo_queues[ch].push_back(bankgroup_queues[bg][index[bg]]);
-//                     index[bg]++;
-//                     progress = true;
-//                 }
-//             }
-//         }
-
-
-//     }
-
-//     // Step 4: pseudo 2개씩 → 실제 channel 1개로 번갈아 분배
-//     for (int ch = 0; ch < 8; ++ch) {
-//         auto& q0 = pseudo_queues[2 * ch];
-//         auto& q1 = pseudo_queues[2 * ch + 1];
-//         auto& out = channel_queues[ch];
-
-//         bool toggle = true;
-//         while (!q0.empty() || !q1.empty()) {
-//             if (toggle && !q0.empty()) {
-//                 out.push_back(q0.front());
-//                 q0.pop_front();
-//             } else if (!toggle && !q1.empty()) {
-//                 out.push_back(q1.front());
-//                 q1.pop_front();
-//             }
-//             toggle = !toggle;
-//         }
-//     }    
-// }
-
-
-
-void RunSimulation(MemorySystem* mem,
-                   std::deque<Transaction> channel_queues[8],
-                   size_t total_transactions) {
+void RunSimulation(MemorySystem* mem, TraceStream& stream) {
     size_t completed = 0;
+    size_t added = 0;
     uint64_t clk = 0;
 
-    auto read_cb  = [&](uint64_t addr) { ++completed; };
-    auto write_cb = [&](uint64_t addr) { ++completed; };
-    mem->RegisterCallbacks(read_cb, write_cb);  // optional override
+    // completions are only counted, poll them rather than take callbacks
+    std::vector<Completion> done(256);
+    mem->EnableCompletionQueue(done.size());
+
+    // a queue that used up its part of the current window offers nothing
+    // until every queue did, then they all move on to the next one
+    int num_queues = stream.NumQueues();
+    std::vector<uint64_t> consumed(num_queues, 0);
+    std::vector<uint64_t> limits(num_queues, 0);
+    bool trace_done = false;
 
-    auto* config = mem->GetConfig();
+    std::vector<Transaction> batch;
+    std::vector<int> batch_queues;  // queue of each batch entry
+    std::vector<int> accepted;
+
+    while (true) {
+        if (!trace_done && consumed == limits) {
+            trace_done = !NextWindow(stream, limits);
+        }
+        if (trace_done && completed == added) {
+            break;
+        }
 
-    while (completed < total_transactions) {
         Logger::PrintCycle(clk);
         mem->ClockTick();
+        size_t polled;
+        while ((polled = mem->PollCompletions(done.data(), done.size())) > 0) {
+            completed += polled;
+        }
 
-        for (int ch = 0; ch < 8; ++ch) {
-            if (!channel_queues[ch].empty()) {
-                auto& t = channel_queues[ch].front();
-                if (mem->WillAcceptTransaction(t.addr, t.is_write)) {                    
-                    mem->AddTransaction(t.addr, t.is_write);
-                    channel_queues[ch].pop_front();
+        // queues never share a channel, so offering every queue head at
+        // once takes the same ones as adding them one by one
+        batch.clear();
+        batch_queues.clear();
+        for (int q = 0; q < num_queues; ++q) {
+            if (consumed[q] < limits[q]) {
+                batch.push_back(*NextTransaction(stream, q));
+                batch_queues.push_back(q);
+            }
+        }
+        if (!batch.empty()) {
+            added += mem->AddTransactions(batch.data(), batch.size(), accepted);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                int& taken = accepted[batch[i].mapped_addr.channel];
+                if (taken > 0) {
+                    taken--;
+                    stream.rings[batch_queues[i]]->Pop();
+                    consumed[batch_queues[i]]++;
                 }
             }
         }
@@ -191,9 +185,48 @@ void RunSimulation(MemorySystem* mem,
 
 
 int main(int argc, char* argv[]) {
+    std::string trace_file = "traces/test.trace";
+    size_t window_size = 1 << 20;
+    TraceOrder order = TraceOrder::ADDRESS;
+    int preprocess_threads =
+        std::max<int>(1, ThreadPool::AllowedCpus().size());
+    std::string save_checkpoint, restore_checkpoint;
+    uint64_t sample_interval = 0, sample_warmup = 20000, sample_measured = 1000;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
-        if (arg == "-D" && i + 1 < argc) {            
+        if (arg == "-t" && i + 1 < argc) {
+            // text, binary or compressed, see trace_file.h
+            trace_file = argv[++i];
+        } else if (arg == "-w" && i + 1 < argc) {
+            // requests read and ordered at a time
+            window_size = std::stoull(argv[++i]);
+        } else if (arg == "-o" && i + 1 < argc) {
+            order = GetTraceOrder(argv[++i]);
+            if (order == TraceOrder::SIZE) {
+                std::cerr << "Unknown order: " << argv[i]
+                          << ", use address, bank or bankgroup" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-j" && i + 1 < argc) {
+            // preprocessing threads
+            preprocess_threads = std::stoi(argv[++i]);
+        } else if (arg == "-s" && i + 1 < argc) {
+            // sampled simulation, one window every this many requests
+            sample_interval = std::stoull(argv[++i]);
+        } else if (arg == "-W" && i + 1 < argc) {
+            // detailed warmup requests before each sampling window
+            sample_warmup = std::stoull(argv[++i]);
+        } else if (arg == "-M" && i + 1 < argc) {
+            // measured requests per sampling window
+            sample_measured = std::stoull(argv[++i]);
+        } else if (arg == "-S" && i + 1 < argc) {
+            // checkpoint the memory system once the trace is done, e.g.
+            // after a warmup trace
+            save_checkpoint = argv[++i];
+        } else if (arg == "-R" && i + 1 < argc) {
+            // continue from a checkpoint taken with -S
+            restore_checkpoint = argv[++i];
+        } else if (arg == "-D" && i + 1 < argc) {            
             g_print_cycle = true;
             std::string opt = argv[++i];
             if (opt == "all") {
@@ -210,7 +243,6 @@ int main(int argc, char* argv[]) {
     }
 
     const std::string config_file = "configs/VCU118_HBM2_4Gb_x128.ini";
-    const std::string trace_file = "traces/test.trace";
     const std::string output_dir = "output";
 
     Logger::Init(output_dir);
@@ -218,12 +250,41 @@ int main(int argc, char* argv[]) {
     auto read_cb = [&](uint64_t addr) { return; };
     auto write_cb = [&](uint64_t addr) { return; };
 
-    std::vector<Transaction> trace = LoadTraceFile(trace_file);    
+    TraceReader reader;
+    if (!reader.Open(trace_file)) {
+        return 1;
+    }
     MemorySystem* mem = new MemorySystem(config_file, output_dir, read_cb, write_cb);
-    std::deque<Transaction> channel_queues[8];
+    if (!restore_checkpoint.empty() &&
+        !mem->RestoreCheckpoint(restore_checkpoint)) {
+        return 1;
+    }
+
+    if (sample_interval > 0) {
+        // requests go in trace order, without the preprocessing below
+        TraceSampler sampler(*mem, sample_interval, sample_warmup,
+                             sample_measured);
+        sampler.Run(reader);
+        sampler.PrintResults(std::cout);
+        mem->PrintStats();
+        delete mem;
+        Logger::Close();
+        return 0;
+    }
 
-    PreprocessTrace(trace, channel_queues, mem);
-    RunSimulation(mem, channel_queues, trace.size());
+    // the two pseudo channels of an HBM channel share a queue
+    const Config& config = *mem->GetConfig();
+    TracePreprocessor preprocessor(config, order, config.IsHBM() ? 2 : 1,
+                                   preprocess_threads);
+    TraceStream stream(preprocessor.NumQueues(), 4096);
+    std::thread trace_reader(StreamTrace, std::ref(reader),
+                             std::ref(preprocessor), std::ref(stream),
+                             window_size);
+    RunSimulation(mem, stream);
+    trace_reader.join();
+    if (!save_checkpoint.empty() && !mem->SaveCheckpoint(save_checkpoint)) {
+        return 1;
+    }
 
     mem->PrintStats();
     delete mem;
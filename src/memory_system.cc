@@ -6,8 +6,10 @@ MemorySystem::MemorySystem(const std::string &config_file,
                            std::function<void(uint64_t)> read_callback,
                            std::function<void(uint64_t)> write_callback)
     : config_(new Config(config_file, output_dir)) {
-    // TODO: ideal memory type?
-    if (config_->IsHMC()) {
+    if (config_->ideal_memory) {
+        dram_system_ = new IdealDRAMSystem(*config_, output_dir, read_callback,
+                                           write_callback);
+    } else if (config_->IsHMC()) {
         dram_system_ = new HMCMemorySystem(*config_, output_dir, read_callback,
                                            write_callback);
     } else {
@@ -37,13 +39,70 @@ void MemorySystem::RegisterCallbacks(
     dram_system_->RegisterCallbacks(read_callback, write_callback);
 }
 
+void MemorySystem::EnableCompletionQueue(size_t capacity) {
+    dram_system_->EnableCompletionQueue(capacity);
+}
+
+size_t MemorySystem::PollCompletions(Completion *completions,
+                                     size_t max_count) {
+    return dram_system_->PollCompletions(completions, max_count);
+}
+
 bool MemorySystem::WillAcceptTransaction(uint64_t hex_addr,
                                          bool is_write) const {
     return dram_system_->WillAcceptTransaction(hex_addr, is_write);
 }
 
 bool MemorySystem::AddTransaction(uint64_t hex_addr, bool is_write) {
-    return dram_system_->AddTransaction(hex_addr, is_write);
+    return dram_system_->AddTransaction(hex_addr, is_write, 0);
+}
+
+bool MemorySystem::AddTransaction(uint64_t hex_addr, bool is_write,
+                                  uint64_t tag) {
+    return dram_system_->AddTransaction(hex_addr, is_write, tag);
+}
+
+size_t MemorySystem::AddTransactions(const Transaction *trans, size_t count,
+                                     std::vector<int> &accepted) {
+    return dram_system_->AddTransactions(trans, count, accepted);
+}
+
+void MemorySystem::ClockTick(uint64_t cycles) {
+    dram_system_->RunUntil(dram_system_->GetClock() + cycles);
+}
+
+void MemorySystem::RunUntil(uint64_t clk) { dram_system_->RunUntil(clk); }
+
+void MemorySystem::Drain() { dram_system_->Drain(); }
+
+uint64_t MemorySystem::GetClock() const { return dram_system_->GetClock(); }
+
+void MemorySystem::FunctionalAccess(uint64_t hex_addr, bool is_write) {
+    dram_system_->FunctionalAccess(hex_addr, is_write);
+}
+
+void MemorySystem::FunctionalAdvance(uint64_t cycles) {
+    dram_system_->FunctionalAdvance(cycles);
+}
+
+bool MemorySystem::SaveCheckpoint(const std::string &file_name) {
+    CheckpointWriter out;
+    dram_system_->Checkpoint(out);
+    return out.WriteFile(file_name, config_->hash);
+}
+
+bool MemorySystem::RestoreCheckpoint(const std::string &file_name) {
+    CheckpointReader in;
+    if (!in.ReadFile(file_name, config_->hash)) {
+        return false;
+    }
+    dram_system_->Restore(in);
+    if (!in.AtEnd()) {
+        std::cerr << "Checkpoint " << file_name << " has trailing data"
+                  << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    return true;
 }
 
 void MemorySystem::PrintStats() const { dram_system_->PrintStats(); }
@@ -0,0 +1,59 @@
+#ifndef __OBJECT_POOL_H
+#define __OBJECT_POOL_H
+
+#include <stddef.h>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dramsim3 {
+
+// Slab allocator for objects created and destroyed at a high rate, e.g.
+// packets. Memory comes in slabs of slab_size objects and freed slots are
+// reused, so once the pool has grown to the peak number of live objects
+// New() and Delete() never allocate. All the memory is released with the
+// pool, objects still out by then are not destroyed.
+template <typename T>
+class ObjectPool {
+   public:
+    explicit ObjectPool(size_t slab_size = 256) : slab_size_(slab_size) {}
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    template <typename... Args>
+    T* New(Args&&... args) {
+        if (free_.empty()) {
+            AddSlab();
+        }
+        void* slot = free_.back();
+        free_.pop_back();
+        return new (slot) T(std::forward<Args>(args)...);
+    }
+
+    void Delete(T* obj) {
+        obj->~T();
+        free_.push_back(obj);
+    }
+
+   private:
+    using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    size_t slab_size_;
+    std::vector<std::unique_ptr<Slot[]>> slabs_;
+    std::vector<void*> free_;
+
+    void AddSlab() {
+        slabs_.emplace_back(new Slot[slab_size_]);
+        Slot* slab = slabs_.back().get();
+        free_.reserve(slabs_.size() * slab_size_);
+        // hand the slots out in address order
+        for (size_t i = slab_size_; i > 0; i--) {
+            free_.push_back(&slab[i - 1]);
+        }
+    }
+};
+
+}  // namespace dramsim3
+#endif
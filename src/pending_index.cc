@@ -0,0 +1,161 @@
+#include "pending_index.h"
+
+namespace dramsim3 {
+
+PendingIndex::PendingIndex(int capacity)
+    : slot_mask_(0), slot_bits_(0), used_slots_(0), free_node_(-1), size_(0) {
+    // keep the table at most half full for the expected number of addresses
+    size_t num_slots = 16;
+    while (num_slots < 2 * static_cast<size_t>(capacity)) {
+        num_slots <<= 1;
+    }
+    Rehash(num_slots);
+    nodes_.reserve(capacity);
+}
+
+size_t PendingIndex::HomeSlot(uint64_t addr) const {
+    // addresses are mostly aligned, fibonacci hashing spreads the high bits
+    return (addr * 0x9E3779B97F4A7C15ull) >> (64 - slot_bits_);
+}
+
+int PendingIndex::FindSlot(uint64_t addr) const {
+    size_t slot = HomeSlot(addr);
+    while (slots_[slot].head >= 0) {
+        if (slots_[slot].addr == addr) {
+            return static_cast<int>(slot);
+        }
+        slot = (slot + 1) & slot_mask_;
+    }
+    return -1;
+}
+
+int PendingIndex::Count(uint64_t addr) const {
+    int slot = FindSlot(addr);
+    return slot < 0 ? 0 : slots_[slot].count;
+}
+
+void PendingIndex::Insert(const Transaction& trans) {
+    int node = AllocNode(trans);
+    size_++;
+    int slot = FindSlot(trans.addr);
+    if (slot >= 0) {
+        nodes_[slots_[slot].tail].next = node;
+        slots_[slot].tail = node;
+        slots_[slot].count++;
+        return;
+    }
+
+    if (2 * (used_slots_ + 1) > slots_.size()) {
+        Rehash(2 * slots_.size());
+    }
+    size_t empty = HomeSlot(trans.addr);
+    while (slots_[empty].head >= 0) {
+        empty = (empty + 1) & slot_mask_;
+    }
+    slots_[empty].addr = trans.addr;
+    slots_[empty].head = node;
+    slots_[empty].tail = node;
+    slots_[empty].count = 1;
+    used_slots_++;
+    return;
+}
+
+bool PendingIndex::PopFront(uint64_t addr, Transaction& trans) {
+    int slot = FindSlot(addr);
+    if (slot < 0) {
+        return false;
+    }
+    int node = slots_[slot].head;
+    trans = nodes_[node].trans;
+    slots_[slot].head = nodes_[node].next;
+    slots_[slot].count--;
+    FreeNode(node);
+    size_--;
+    if (slots_[slot].count == 0) {
+        EraseSlot(slot);
+    }
+    return true;
+}
+
+void PendingIndex::EraseSlot(size_t slot) {
+    // backward shift deletion, so lookups never need tombstones
+    slots_[slot].head = -1;
+    used_slots_--;
+    size_t hole = slot;
+    size_t next = (hole + 1) & slot_mask_;
+    while (slots_[next].head >= 0) {
+        size_t home = HomeSlot(slots_[next].addr);
+        // an entry can fill the hole if its home isn't in (hole, next]
+        bool stays = hole <= next ? (hole < home && home <= next)
+                                  : (hole < home || home <= next);
+        if (!stays) {
+            slots_[hole] = slots_[next];
+            slots_[next].head = -1;
+            hole = next;
+        }
+        next = (next + 1) & slot_mask_;
+    }
+    return;
+}
+
+void PendingIndex::Rehash(size_t num_slots) {
+    std::vector<Slot> old_slots;
+    old_slots.swap(slots_);
+    slots_.assign(num_slots, Slot{0, -1, -1, 0});
+    slot_mask_ = num_slots - 1;
+    slot_bits_ = 0;
+    while ((static_cast<size_t>(1) << slot_bits_) < num_slots) {
+        slot_bits_++;
+    }
+    for (const auto& old_slot : old_slots) {
+        if (old_slot.head < 0) {
+            continue;
+        }
+        size_t slot = HomeSlot(old_slot.addr);
+        while (slots_[slot].head >= 0) {
+            slot = (slot + 1) & slot_mask_;
+        }
+        slots_[slot] = old_slot;
+    }
+    return;
+}
+
+int PendingIndex::AllocNode(const Transaction& trans) {
+    int node = free_node_;
+    if (node >= 0) {
+        free_node_ = nodes_[node].next;
+        nodes_[node].trans = trans;
+    } else {
+        node = static_cast<int>(nodes_.size());
+        nodes_.push_back(Node{trans, -1});
+    }
+    nodes_[node].next = -1;
+    return node;
+}
+
+void PendingIndex::FreeNode(int node) {
+    nodes_[node].next = free_node_;
+    free_node_ = node;
+    return;
+}
+
+void PendingIndex::Checkpoint(CheckpointWriter& out) const {
+    // only the order within an address matters, slots go in table order
+    out.Put(static_cast<uint64_t>(size_));
+    for (const auto& slot : slots_) {
+        for (int node = slot.head; node >= 0; node = nodes_[node].next) {
+            out.Put(nodes_[node].trans);
+        }
+    }
+}
+
+void PendingIndex::Restore(CheckpointReader& in) {
+    size_t size = in.GetSize();
+    for (size_t i = 0; i < size; i++) {
+        Transaction trans;
+        in.Get(trans);
+        Insert(trans);
+    }
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,61 @@
+#ifndef __PENDING_INDEX_H
+#define __PENDING_INDEX_H
+
+#include <stdint.h>
+#include <vector>
+#include "checkpoint.h"
+#include "common.h"
+
+namespace dramsim3 {
+
+// Transactions waiting on a command, indexed by address. An open addressing
+// (linear probing) table maps each address to an intrusive FIFO of
+// transactions kept in a pooled node array, so once the pool and table have
+// grown to the working set inserts and removals don't allocate. Transactions
+// with the same address come back out in the order they were inserted.
+class PendingIndex {
+   public:
+    PendingIndex(int capacity);
+    size_t Size() const { return size_; }
+    bool Contains(uint64_t addr) const { return FindSlot(addr) >= 0; }
+    int Count(uint64_t addr) const;
+    void Insert(const Transaction& trans);
+
+    // remove the oldest transaction of addr into trans, false if there is none
+    bool PopFront(uint64_t addr, Transaction& trans);
+
+    // Restore() expects an empty index
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
+
+   private:
+    struct Node {
+        Transaction trans;
+        int next;
+    };
+    struct Slot {
+        uint64_t addr;
+        int head;  // -1 for an empty slot
+        int tail;
+        int count;
+    };
+
+    size_t HomeSlot(uint64_t addr) const;
+    int FindSlot(uint64_t addr) const;
+    void EraseSlot(size_t slot);
+    void Rehash(size_t num_slots);
+    int AllocNode(const Transaction& trans);
+    void FreeNode(int node);
+
+    std::vector<Slot> slots_;
+    size_t slot_mask_;
+    int slot_bits_;
+    size_t used_slots_;
+
+    std::vector<Node> nodes_;
+    int free_node_;
+    size_t size_;
+};
+
+}  // namespace dramsim3
+#endif
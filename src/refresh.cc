@@ -1,5 +1,7 @@
 #include "refresh.h"
 
+#include <algorithm>
+
 namespace dramsim3 {
 Refresh::Refresh(const Config &config, ChannelState &channel_state)
     : clk_(0),
@@ -26,6 +28,53 @@ void Refresh::ClockTick() {
     return;
 }
 
+uint64_t Refresh::NextRefreshCycle() const {
+    // the first cycle at or after clk_ where ClockTick() inserts a refresh
+    uint64_t interval = static_cast<uint64_t>(refresh_interval_);
+    uint64_t next = (clk_ + interval - 1) / interval * interval;
+    return next == 0 ? interval : next;
+}
+
+void Refresh::FunctionalForward(uint64_t clk) {
+    uint64_t next = NextRefreshCycle();
+    if (clk > next) {
+        // refreshes only close rows in the functional model, so out of a long
+        // stretch only the last round through the refresh targets matters
+        uint64_t interval = static_cast<uint64_t>(refresh_interval_);
+        uint64_t count = (clk - 1 - next) / interval + 1;
+        uint64_t targets = 1;
+        if (refresh_policy_ == RefreshPolicy::RANK_LEVEL_STAGGERED) {
+            targets = config_.ranks;
+        } else if (refresh_policy_ == RefreshPolicy::BANK_LEVEL_STAGGERED) {
+            targets = config_.ranks * config_.banks;
+        }
+        uint64_t inserted = std::min(count, targets);
+        if (refresh_policy_ != RefreshPolicy::RANK_LEVEL_SIMULTANEOUS) {
+            for (uint64_t i = 0; i < (count - inserted) % targets; i++) {
+                IterateNext();
+            }
+        }
+        for (uint64_t i = 0; i < inserted; i++) {
+            InsertRefresh();
+        }
+    }
+    clk_ = std::max(clk_, clk);
+}
+
+void Refresh::Checkpoint(CheckpointWriter& out) const {
+    out.Put(clk_);
+    out.Put(next_rank_);
+    out.Put(next_bg_);
+    out.Put(next_bank_);
+}
+
+void Refresh::Restore(CheckpointReader& in) {
+    in.Get(clk_);
+    in.Get(next_rank_);
+    in.Get(next_bg_);
+    in.Get(next_bank_);
+}
+
 void Refresh::InsertRefresh() {
     switch (refresh_policy_) {
         // Simultaneous all rank refresh
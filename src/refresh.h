@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "channel_state.h"
+#include "checkpoint.h"
 #include "common.h"
 #include "configuration.h"
 
@@ -12,6 +13,12 @@ class Refresh {
    public:
     Refresh(const Config& config, ChannelState& channel_state);
     void ClockTick();
+    void FastForward(uint64_t clk) { clk_ = clk; }
+    // Functional model: queue the refreshes due before clk without ticking
+    void FunctionalForward(uint64_t clk);
+    uint64_t NextRefreshCycle() const;
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
 
    private:
     uint64_t clk_;
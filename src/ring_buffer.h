@@ -0,0 +1,76 @@
+#ifndef __RING_BUFFER_H
+#define __RING_BUFFER_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace dramsim3 {
+
+// FIFO over a power of 2 array, single threaded (see SPSCRing for the
+// threaded one). Push() doubles the array when it is full, so a capacity
+// that covers the steady state means no allocation after construction.
+template <typename T>
+class RingBuffer {
+   public:
+    // capacity is rounded up to a power of 2
+    explicit RingBuffer(size_t capacity = 16) : head_(0), size_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    bool Empty() const { return size_ == 0; }
+    bool Full() const { return size_ == slots_.size(); }
+    size_t Size() const { return size_; }
+    size_t Capacity() const { return slots_.size(); }
+
+    // i-th oldest element
+    T& operator[](size_t i) { return slots_[(head_ + i) & mask_]; }
+    const T& operator[](size_t i) const { return slots_[(head_ + i) & mask_]; }
+    T& Front() { return slots_[head_]; }
+    const T& Front() const { return slots_[head_]; }
+
+    void Push(const T& item) {
+        if (Full()) {
+            Grow();
+        }
+        slots_[(head_ + size_) & mask_] = item;
+        size_++;
+    }
+    void Pop() {
+        head_ = (head_ + 1) & mask_;
+        size_--;
+    }
+    void Reserve(size_t capacity) {
+        while (slots_.size() < capacity) {
+            Grow();
+        }
+    }
+    void Clear() {
+        head_ = 0;
+        size_ = 0;
+    }
+
+   private:
+    std::vector<T> slots_;
+    size_t mask_;
+    size_t head_;
+    size_t size_;
+
+    void Grow() {
+        // unwrap into an array twice the size
+        std::vector<T> grown(2 * slots_.size());
+        for (size_t i = 0; i < size_; i++) {
+            grown[i] = (*this)[i];
+        }
+        slots_.swap(grown);
+        mask_ = slots_.size() - 1;
+        head_ = 0;
+    }
+};
+
+}  // namespace dramsim3
+#endif
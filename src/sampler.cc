@@ -0,0 +1,230 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace dramsim3 {
+
+namespace {
+// normal approximation, there are usually tens of windows or more
+const double kConfidenceZ = 1.96;
+// fixed, so that a sampled run can be repeated
+const uint64_t kOffsetSeed = 0x5eed;
+}  // namespace
+
+void TraceSampler::SampleStat::Add(double value) {
+    count_++;
+    double delta = value - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (value - mean_);
+}
+
+double TraceSampler::SampleStat::Stddev() const {
+    return count_ > 1 ? std::sqrt(m2_ / (count_ - 1)) : 0.0;
+}
+
+double TraceSampler::SampleStat::HalfWidth() const {
+    return count_ > 0 ? kConfidenceZ * Stddev() / std::sqrt(count_) : 0.0;
+}
+
+TraceSampler::TraceSampler(MemorySystem& memory_system, uint64_t interval,
+                           uint64_t warmup, uint64_t measured)
+    : memory_system_(memory_system),
+      interval_(interval),
+      warmup_(warmup),
+      measured_(measured),
+      request_bytes_(memory_system.GetBusBits() *
+                     memory_system.GetBurstLength() / 8),
+      clk_(memory_system.GetClock()),
+      ts_offset_(0),
+      last_timestamp_(0),
+      stretch_clk_(0),
+      stretch_request_(0),
+      gen_(kOffsetSeed),
+      offset_(0),
+      done_(256),
+      detailed_(false),
+      issued_(0),
+      completed_(0),
+      total_requests_(0),
+      detailed_requests_(0) {
+    if (measured_ == 0 || interval_ < warmup_ + measured_) {
+        std::cerr << "Sampling interval " << interval_
+                  << " can't hold a warmup of " << warmup_ << " and "
+                  << measured_ << " measured requests" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    memory_system_.EnableCompletionQueue(done_.size());
+}
+
+void TraceSampler::Run(TraceReader& trace) {
+    std::vector<Transaction> buffer;
+    while (trace.Read(buffer, kCodecBlockSize) > 0) {
+        for (const auto& trans : buffer) {
+            uint64_t pos = total_requests_ % interval_;
+            if (pos == 0) {
+                std::uniform_int_distribution<uint64_t> dist(
+                    0, interval_ - warmup_ - measured_);
+                offset_ = dist(gen_);
+            }
+            if ((pos >= offset_ && pos < offset_ + warmup_ + measured_) ||
+                !windows_.empty()) {
+                if (!detailed_) {
+                    ts_offset_ = clk_ - trans.added_cycle;
+                    stretch_clk_ = clk_;
+                    stretch_request_ = total_requests_;
+                    detailed_ = true;
+                }
+                if (pos == offset_ + warmup_) {
+                    Window window = {issued_, issued_ + measured_, clk_, 0,
+                                     measured_, 0, 0};
+                    windows_.push_back(window);
+                }
+                Issue(trans);
+            } else {
+                if (detailed_) {
+                    Drain();
+                }
+                Functional(trans, trace.HasTimestamps());
+            }
+            last_timestamp_ = trans.added_cycle;
+            total_requests_++;
+        }
+        buffer.clear();
+    }
+    Drain();
+}
+
+void TraceSampler::Issue(const Transaction& trans) {
+    // time only moves on when the request is not due yet or is refused
+    while (trans.added_cycle + ts_offset_ > clk_ ||
+           !memory_system_.WillAcceptTransaction(trans.addr, trans.is_write)) {
+        Tick();
+    }
+    memory_system_.AddTransaction(trans.addr, trans.is_write, issued_++);
+    detailed_requests_++;
+}
+
+void TraceSampler::Functional(const Transaction& trans, bool has_timestamps) {
+    uint64_t cycles = 0;
+    if (has_timestamps) {
+        if (trans.added_cycle > last_timestamp_) {
+            cycles = trans.added_cycle - last_timestamp_;
+        }
+    } else {
+        // time since the detailed stretch started goes at the mean pace of
+        // the windows so far. Adding to the drain instead, or following the
+        // last window alone, lets the stretches lock onto the refresh period.
+        uint64_t target =
+            stretch_clk_ + static_cast<uint64_t>(
+                               (total_requests_ + 1 - stretch_request_) *
+                               cycles_per_req_.Mean());
+        if (target > clk_) {
+            cycles = target - clk_;
+        }
+    }
+    if (cycles > 0) {
+        memory_system_.FunctionalAdvance(cycles);
+        clk_ += cycles;
+    }
+    memory_system_.FunctionalAccess(trans.addr, trans.is_write);
+}
+
+void TraceSampler::Tick() {
+    memory_system_.ClockTick();
+    clk_++;
+    Collect();
+}
+
+void TraceSampler::Drain() {
+    memory_system_.Drain();
+    clk_ = memory_system_.GetClock();
+    Collect();
+    // a window cut short by the end of the trace is dropped
+    detailed_ = false;
+    issued_ = 0;
+    completed_ = 0;
+    windows_.clear();
+}
+
+void TraceSampler::Collect() {
+    size_t count;
+    while ((count = memory_system_.PollCompletions(done_.data(),
+                                                   done_.size())) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            const Completion& done = done_[i];
+            // completions come in cycle order
+            uint64_t cycle = done.complete_cycle + 1;
+            completed_++;
+            for (auto& window : windows_) {
+                if (completed_ == window.first) {
+                    window.start = cycle;
+                } else if (completed_ == window.last) {
+                    window.end = cycle;
+                }
+                if (done.tag >= window.first && done.tag < window.last) {
+                    window.measured_left--;
+                    if (!done.is_write) {
+                        window.reads++;
+                        window.latency +=
+                            done.complete_cycle - done.added_cycle;
+                    }
+                }
+            }
+            // the requests behind a window keep going until its last
+            // measured one is done
+            while (!windows_.empty() && completed_ >= windows_.front().last &&
+                   windows_.front().measured_left == 0) {
+                EndWindow(windows_.front());
+                windows_.pop_front();
+            }
+        }
+    }
+}
+
+void TraceSampler::EndWindow(const Window& window) {
+    double cycles = static_cast<double>(window.end - window.start);
+    cycles_per_req_.Add(cycles / measured_);
+    if (window.reads > 0) {
+        read_latency_.Add(static_cast<double>(window.latency) / window.reads);
+    }
+}
+
+void TraceSampler::PrintResults(std::ostream& out) const {
+    uint64_t windows = cycles_per_req_.Count();
+    out << "[Sampling] " << windows << " windows of " << measured_
+        << " requests, " << detailed_requests_ << " of " << total_requests_
+        << " requests simulated in detail" << std::endl;
+    if (windows == 0) {
+        return;
+    }
+    auto print = [&out](const char* name, const SampleStat& stat,
+                        const char* unit) {
+        double half = stat.HalfWidth();
+        out << "[Sampling] " << name << " " << stat.Mean() << " " << unit
+            << " +- " << half << " (95% CI, +-"
+            << (stat.Mean() > 0 ? 100 * half / stat.Mean() : 0) << "%)"
+            << std::endl;
+    };
+    out << std::fixed << std::setprecision(2);
+    // bandwidth follows from the mean cycles per request, so that it agrees
+    // with the estimated cycles
+    double cycles = cycles_per_req_.Mean();
+    double bandwidth =
+        cycles > 0 ? request_bytes_ / (cycles * memory_system_.GetTCK()) : 0;
+    double half = cycles > 0 ? bandwidth * cycles_per_req_.HalfWidth() / cycles
+                             : 0;
+    out << "[Sampling] bandwidth " << bandwidth << " GB/s +- " << half
+        << " (95% CI, +-" << (bandwidth > 0 ? 100 * half / bandwidth : 0)
+        << "%)" << std::endl;
+    print("read latency", read_latency_, "cycles");
+
+    out << std::setprecision(0) << "[Sampling] estimated cycles "
+        << cycles_per_req_.Mean() * total_requests_ << " +- "
+        << cycles_per_req_.HalfWidth() * total_requests_ << std::endl;
+    out.unsetf(std::ios_base::floatfield);
+    out << std::setprecision(6);
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,119 @@
+#ifndef __SAMPLER_H
+#define __SAMPLER_H
+
+#include <stdint.h>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "memory_system.h"
+#include "trace_file.h"
+
+namespace dramsim3 {
+
+// SMARTS style sampled simulation of a trace. The trace is cut into
+// intervals of interval requests. At a random point of each interval warmup
+// requests are simulated in detail to warm the queues up and the next
+// measured ones are simulated in detail and measured. The random start keeps
+// the windows from locking onto periodic events such as refresh, which a
+// window at the same point of every interval can miss or hit every time.
+// The requests after the measured ones stay in detail until the last
+// measured one completes, so a window never sees the memory system drain.
+// Only then is it drained, and the rest of the interval goes through the
+// functional model, which keeps the open rows and the refresh phase warm for
+// the next window. Requests go in trace order, as many per cycle as the
+// memory system takes. The warmup has to cover the queues filling up again
+// after the drain, read latency takes longer to settle than bandwidth: about
+// 20000 requests for uniform random reads on HBM2.
+//
+// A window is timed on the completions rather than on the requests, which
+// finish out of order: it starts with the completion that has as many before
+// it as there are requests before the first measured one and spans one
+// completion per measured request. Back to back windows add up to the cycles
+// of a full detailed run.
+//
+// Without timestamps in the trace the functional model advances time by the
+// mean cycles per request of the windows so far. Cycles per request and
+// read latency are reported as the mean over the measured windows with a 95%
+// confidence interval, bandwidth and the cycles of the whole trace follow
+// from the cycles per request.
+class TraceSampler {
+   public:
+    TraceSampler(MemorySystem& memory_system, uint64_t interval,
+                 uint64_t warmup, uint64_t measured);
+    void Run(TraceReader& trace);
+    void PrintResults(std::ostream& out) const;
+
+   private:
+    // running mean and variance over the windows (Welford)
+    class SampleStat {
+       public:
+        SampleStat() : count_(0), mean_(0), m2_(0) {}
+        void Add(double value);
+        uint64_t Count() const { return count_; }
+        double Mean() const { return mean_; }
+        double Stddev() const;
+        // half width of the 95% confidence interval of the mean
+        double HalfWidth() const;
+
+       private:
+        uint64_t count_;
+        double mean_;
+        double m2_;
+    };
+
+    MemorySystem& memory_system_;
+    uint64_t interval_;
+    uint64_t warmup_;
+    uint64_t measured_;
+    uint64_t request_bytes_;
+    uint64_t clk_;
+
+    // trace timestamp + ts_offset_ is the cycle a request can be issued at,
+    // re-based at the start of every detailed stretch
+    uint64_t ts_offset_;
+    uint64_t last_timestamp_;
+    // where and at which request the current detailed stretch started
+    uint64_t stretch_clk_;
+    uint64_t stretch_request_;
+    // where in the current interval its warmup starts
+    std::mt19937_64 gen_;
+    uint64_t offset_;
+
+    // completions are polled, the tag is the number of the request in
+    // issue order within the detailed stretch
+    std::vector<Completion> done_;
+
+    // measured requests [first, last), the window runs from the first-th
+    // to the last-th completion of the stretch
+    struct Window {
+        uint64_t first;
+        uint64_t last;
+        uint64_t start;
+        uint64_t end;
+        uint64_t measured_left;
+        uint64_t reads;
+        uint64_t latency;
+    };
+
+    // current detailed stretch, requests are numbered in issue order
+    bool detailed_;
+    uint64_t issued_;
+    uint64_t completed_;
+    std::deque<Window> windows_;
+
+    SampleStat read_latency_;
+    SampleStat cycles_per_req_;
+    uint64_t total_requests_;
+    uint64_t detailed_requests_;
+
+    void Issue(const Transaction& trans);
+    void Functional(const Transaction& trans, bool has_timestamps);
+    void Tick();
+    void Drain();
+    void Collect();
+    void EndWindow(const Window& window);
+};
+
+}  // namespace dramsim3
+#endif
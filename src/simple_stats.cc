@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+#include "common.h"
 #include "fmt/format.h"
 #include "simple_stats.h"
 
@@ -16,6 +19,110 @@ void PrintStatText(std::ostream& where, std::string name, T value,
     return;
 }
 
+int LatencyHistogram::BucketIndex(uint64_t value) {
+    if (value < 2 * kSubBuckets) {
+        return static_cast<int>(value);
+    }
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - kSubBucketBits;
+    return static_cast<int>((shift * kSubBuckets) + (value >> shift));
+}
+
+uint64_t LatencyHistogram::BucketLowest(int index) {
+    if (index < static_cast<int>(2 * kSubBuckets)) {
+        return index;
+    }
+    int shift = index / kSubBuckets - 1;
+    uint64_t sub_bucket = index - shift * kSubBuckets;
+    return sub_bucket << shift;
+}
+
+uint64_t LatencyHistogram::BucketHighest(int index) {
+    if (index < static_cast<int>(2 * kSubBuckets)) {
+        return index;
+    }
+    int shift = index / kSubBuckets - 1;
+    uint64_t sub_bucket = index - shift * kSubBuckets;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Add(uint64_t value) {
+    size_t index = BucketIndex(value);
+    if (index >= counts_.size()) {
+        counts_.resize(index + 1, 0);
+    }
+    counts_[index]++;
+    count_++;
+    sum_ += value;
+    max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    if (other.counts_.size() > counts_.size()) {
+        counts_.resize(other.counts_.size(), 0);
+    }
+    for (size_t i = 0; i < other.counts_.size(); i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
+
+void LatencyHistogram::Clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+void LatencyHistogram::Checkpoint(CheckpointWriter& out) const {
+    out.Put(counts_);
+    out.Put(count_);
+    out.Put(sum_);
+    out.Put(max_);
+}
+
+void LatencyHistogram::Restore(CheckpointReader& in) {
+    in.Get(counts_);
+    in.Get(count_);
+    in.Get(sum_);
+    in.Get(max_);
+}
+
+double LatencyHistogram::Average() const {
+    return count_ == 0
+               ? 0.0
+               : static_cast<double>(sum_) / static_cast<double>(count_);
+}
+
+uint64_t LatencyHistogram::ValueAtPercentile(double percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t target = static_cast<uint64_t>(
+        std::ceil(percentile / 100.0 * static_cast<double>(count_)));
+    target = std::max(target, static_cast<uint64_t>(1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        seen += counts_[i];
+        if (seen >= target) {
+            return std::min(BucketHighest(i), max_);
+        }
+    }
+    return max_;
+}
+
+std::vector<std::pair<uint64_t, uint64_t> > LatencyHistogram::Buckets() const {
+    std::vector<std::pair<uint64_t, uint64_t> > buckets;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        if (counts_[i] > 0) {
+            buckets.emplace_back(BucketLowest(i), counts_[i]);
+        }
+    }
+    return buckets;
+}
+
 SimpleStats::SimpleStats(const Config& config, int channel_id)
     : config_(config), channel_id_(channel_id) {
     // counter stats
@@ -75,14 +182,12 @@ SimpleStats::SimpleStats(const Config& config, int channel_id)
              "Average read request latency (cycles)");
     InitStat("average_interarrival", "calculated",
              "Average request interarrival latency (cycles)");
-}
 
-void SimpleStats::AddValue(const std::string name, const int value) {
-    auto& epoch_counts = epoch_histo_counts_[name];
-    if (epoch_counts.count(value) <= 0) {
-        epoch_counts[value] = 1;
-    } else {
-        epoch_counts[value] += 1;
+    if (counter_names_.size() != static_cast<size_t>(Counter::SIZE) ||
+        vec_counter_names_.size() != static_cast<size_t>(VecCounter::SIZE) ||
+        histo_names_.size() != static_cast<size_t>(Histogram::SIZE)) {
+        std::cerr << "Built-in stats out of sync with their ids" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
     }
 }
 
@@ -144,6 +249,7 @@ void SimpleStats::PrintFinalStats() {
 }
 
 void SimpleStats::Reset() {
+    ClearEpochCounters();
     for (auto& it : counters_) {
         it.second = 0;
     }
@@ -165,11 +271,43 @@ void SimpleStats::Reset() {
     for (auto& it : calculated_) {
         it.second = 0.0;
     }
-    for (auto& it : histo_counts_) {
-        it.second.clear();
+    for (auto& histo : histos_) {
+        histo.Clear();
+    }
+    for (auto& histo : epoch_histos_) {
+        histo.Clear();
+    }
+}
+
+void SimpleStats::Checkpoint(CheckpointWriter& out) const {
+    for (const auto& name : counter_names_) {
+        out.Put(counters_.at(name));
+    }
+    out.Put(epoch_counter_vals_);
+    for (const auto& name : vec_counter_names_) {
+        out.Put(vec_counters_.at(name));
+    }
+    out.Put(epoch_vec_counter_vals_);
+    for (size_t id = 0; id < histo_names_.size(); id++) {
+        histos_[id].Checkpoint(out);
+        epoch_histos_[id].Checkpoint(out);
+        out.Put(histo_bins_.at(histo_names_[id]));
+    }
+}
+
+void SimpleStats::Restore(CheckpointReader& in) {
+    for (const auto& name : counter_names_) {
+        in.Get(counters_[name]);
+    }
+    in.Get(epoch_counter_vals_);
+    for (const auto& name : vec_counter_names_) {
+        in.Get(vec_counters_[name]);
     }
-    for (auto& it : epoch_histo_counts_) {
-        it.second.clear();
+    in.Get(epoch_vec_counter_vals_);
+    for (size_t id = 0; id < histo_names_.size(); id++) {
+        histos_[id].Restore(in);
+        epoch_histos_[id].Restore(in);
+        in.Get(histo_bins_[histo_names_[id]]);
     }
 }
 
@@ -179,6 +317,9 @@ void SimpleStats::InitStat(std::string name, std::string stat_type,
     if (stat_type == "counter") {
         counters_.emplace(name, 0);
         epoch_counters_.emplace(name, 0);
+        counter_ids_.emplace(name, counter_names_.size());
+        counter_names_.push_back(name);
+        epoch_counter_vals_.push_back(0);
     } else if (stat_type == "double") {
         doubles_.emplace(name, 0.0);
     } else if (stat_type == "calculated") {
@@ -198,6 +339,9 @@ void SimpleStats::InitVecStat(std::string name, std::string stat_type,
     if (stat_type == "vec_counter") {
         vec_counters_.emplace(name, std::vector<uint64_t>(vec_len, 0));
         epoch_vec_counters_.emplace(name, std::vector<uint64_t>(vec_len, 0));
+        vec_counter_ids_.emplace(name, vec_counter_names_.size());
+        vec_counter_names_.push_back(name);
+        epoch_vec_counter_vals_.push_back(std::vector<uint64_t>(vec_len, 0));
     } else if (stat_type == "vec_double") {
         vec_doubles_.emplace(name, std::vector<double>(vec_len, 0));
     }
@@ -208,8 +352,10 @@ void SimpleStats::InitHistoStat(std::string name, std::string description,
     int bin_width = (end_val - start_val) / num_bins;
     bin_widths_.emplace(name, bin_width);
     histo_bounds_.emplace(name, std::make_pair(start_val, end_val));
-    histo_counts_.emplace(name, std::unordered_map<int, uint64_t>());
-    epoch_histo_counts_.emplace(name, std::unordered_map<int, uint64_t>());
+    histo_ids_.emplace(name, histo_names_.size());
+    histo_names_.push_back(name);
+    histos_.emplace_back();
+    epoch_histos_.emplace_back();
 
     // initialize headers, descriptions
     std::vector<std::string> headers;
@@ -232,9 +378,34 @@ void SimpleStats::InitHistoStat(std::string name, std::string description,
     // +2 for front and end
     histo_bins_.emplace(name, std::vector<uint64_t>(num_bins + 2, 0));
     epoch_histo_bins_.emplace(name, std::vector<uint64_t>(num_bins + 2, 0));
+
+    // tail latencies
+    InitStat(name + "_p50", "calculated", description + " 50th percentile");
+    InitStat(name + "_p90", "calculated", description + " 90th percentile");
+    InitStat(name + "_p99", "calculated", description + " 99th percentile");
+    InitStat(name + "_p999", "calculated",
+             description + " 99.9th percentile");
+    InitStat(name + "_max", "calculated", description + " maximum");
+}
+
+void SimpleStats::CollectEpochCounters() {
+    for (size_t i = 0; i < counter_names_.size(); i++) {
+        epoch_counters_[counter_names_[i]] = epoch_counter_vals_[i];
+    }
+    for (size_t i = 0; i < vec_counter_names_.size(); i++) {
+        epoch_vec_counters_[vec_counter_names_[i]] = epoch_vec_counter_vals_[i];
+    }
+}
+
+void SimpleStats::ClearEpochCounters() {
+    std::fill(epoch_counter_vals_.begin(), epoch_counter_vals_.end(), 0);
+    for (auto& vec : epoch_vec_counter_vals_) {
+        std::fill(vec.begin(), vec.end(), 0);
+    }
 }
 
 void SimpleStats::UpdateCounters() {
+    CollectEpochCounters();
     for (const auto& it : epoch_counters_) {
         counters_[it.first] += it.second;
     }
@@ -246,17 +417,18 @@ void SimpleStats::UpdateCounters() {
 }
 
 void SimpleStats::UpdateHistoBins() {
-    for (auto& name_bins : epoch_histo_bins_) {
-        const auto& name = name_bins.first;
-        auto& bins = name_bins.second;
+    for (size_t id = 0; id < histo_names_.size(); id++) {
+        const auto& name = histo_names_[id];
+        auto& bins = epoch_histo_bins_[name];
         std::fill(bins.begin(), bins.end(), 0);
-        for (const auto it : epoch_histo_counts_[name]) {
-            int value = it.first;
+        for (const auto& it : epoch_histos_[id].Buckets()) {
+            uint64_t value = it.first;
             uint64_t count = it.second;
             int bin_idx = 0;
-            if (value < histo_bounds_[name].first) {
+            if (value < static_cast<uint64_t>(histo_bounds_[name].first)) {
                 bin_idx = 0;
-            } else if (value > histo_bounds_[name].second) {
+            } else if (value >
+                       static_cast<uint64_t>(histo_bounds_[name].second)) {
                 bin_idx = bins.size() - 1;
             } else {
                 bin_idx =
@@ -264,37 +436,27 @@ void SimpleStats::UpdateHistoBins() {
             }
             bins[bin_idx] += count;
         }
-    }
 
-    // update overall histogram counts based on epoch histo counts
-    for (auto& name_counts : epoch_histo_counts_) {
-        const auto& name = name_counts.first;
-        auto& epoch_counts = name_counts.second;
-        auto& final_counts = histo_counts_[name];
-        for (const auto& val_cnt : epoch_counts) {
-            if (final_counts.count(val_cnt.first) <= 0) {
-                final_counts[val_cnt.first] = val_cnt.second;
-            } else {
-                final_counts[val_cnt.first] += val_cnt.second;
-            }
-        }
+        // update overall histogram based on the epoch histogram
+        histos_[id].Merge(epoch_histos_[id]);
         auto& final_bins = histo_bins_[name];
         for (size_t i = 0; i < final_bins.size(); i++) {
-            final_bins[i] += epoch_histo_bins_[name][i];
+            final_bins[i] += bins[i];
         }
     }
 }
 
-double SimpleStats::GetHistoAvg(const HistoCount& hist_counts) const {
-    uint64_t accu_sum = 0;
-    uint64_t count = 0;
-    for (auto i = hist_counts.begin(); i != hist_counts.end(); i++) {
-        accu_sum += i->first * i->second;
-        count += i->second;
+void SimpleStats::UpdatePercentiles(bool epoch) {
+    const auto& ref_histos = epoch ? epoch_histos_ : histos_;
+    for (size_t id = 0; id < histo_names_.size(); id++) {
+        const auto& name = histo_names_[id];
+        const auto& histo = ref_histos[id];
+        calculated_[name + "_p50"] = histo.ValueAtPercentile(50.0);
+        calculated_[name + "_p90"] = histo.ValueAtPercentile(90.0);
+        calculated_[name + "_p99"] = histo.ValueAtPercentile(99.0);
+        calculated_[name + "_p999"] = histo.ValueAtPercentile(99.9);
+        calculated_[name + "_max"] = histo.Max();
     }
-    return count == 0
-               ? 0.0
-               : static_cast<double>(accu_sum) / static_cast<double>(count);
 }
 
 void SimpleStats::UpdatePrints(bool epoch) {
@@ -331,12 +493,12 @@ void SimpleStats::UpdatePrints(bool epoch) {
     // huge therefore we only put aggregated histo in each epoch but
     // complete data at the end
     if (!epoch) {
-        for (const auto& name_hist : histo_counts_) {
+        for (size_t id = 0; id < histo_names_.size(); id++) {
             Json j_list;
-            for (const auto& it : name_hist.second) {
+            for (const auto& it : histos_[id].Buckets()) {
                 j_list[std::to_string(it.first)] = it.second;
             }
-            j_data_[name_hist.first] = j_list;
+            j_data_[histo_names_[id]] = j_list;
         }
     }
 
@@ -406,19 +568,22 @@ void SimpleStats::UpdateEpochStats() {
     calculated_["total_energy"] = total_energy;
     calculated_["average_power"] = total_energy / epoch_counters_["num_cycles"];
     calculated_["average_read_latency"] =
-        GetHistoAvg(epoch_histo_counts_.at("read_latency"));
+        epoch_histos_[static_cast<int>(Histogram::READ_LATENCY)].Average();
     calculated_["average_interarrival"] =
-        GetHistoAvg(epoch_histo_counts_.at("interarrival_latency"));
+        epoch_histos_[static_cast<int>(Histogram::INTERARRIVAL_LATENCY)]
+            .Average();
+    UpdatePercentiles(true);
 
     UpdatePrints(true);
+    ClearEpochCounters();
     for (auto& it : epoch_counters_) {
         it.second = 0;
     }
     for (auto& vec : epoch_vec_counters_) {
         std::fill(vec.second.begin(), vec.second.end(), 0);
     }
-    for (auto& it : epoch_histo_counts_) {
-        it.second.clear();
+    for (auto& histo : epoch_histos_) {
+        histo.Clear();
     }
     return;
 }
@@ -466,11 +631,11 @@ void SimpleStats::UpdateFinalStats() {
                           doubles_["refb_energy"] + background_energy;
     calculated_["total_energy"] = total_energy;
     calculated_["average_power"] = total_energy / counters_["num_cycles"];
-    // calculated_["average_read_latency"] = GetHistoAvg("read_latency");
     calculated_["average_read_latency"] =
-        GetHistoAvg(histo_counts_.at("read_latency"));
+        histos_[static_cast<int>(Histogram::READ_LATENCY)].Average();
     calculated_["average_interarrival"] =
-        GetHistoAvg(histo_counts_.at("interarrival_latency"));
+        histos_[static_cast<int>(Histogram::INTERARRIVAL_LATENCY)].Average();
+    UpdatePercentiles(false);
 
     UpdatePrints(false);
     return;
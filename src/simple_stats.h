@@ -6,29 +6,124 @@
 #include <unordered_map>
 #include <vector>
 
+#include "checkpoint.h"
 #include "configuration.h"
 #include "json.hpp"
 
 namespace dramsim3 {
 
+// Built-in counters, in the order they are initialized in the SimpleStats
+// constructor so the enum value is also the counter's registry id
+enum class Counter {
+    NUM_CYCLES,
+    EPOCH_NUM,
+    NUM_READS_DONE,
+    NUM_WRITES_DONE,
+    NUM_WRITE_BUF_HITS,
+    NUM_READ_ROW_HITS,
+    NUM_WRITE_ROW_HITS,
+    NUM_READ_CMDS,
+    NUM_WRITE_CMDS,
+    NUM_ACT_CMDS,
+    NUM_PRE_CMDS,
+    NUM_ONDEMAND_PRES,
+    NUM_REF_CMDS,
+    NUM_REFB_CMDS,
+    NUM_SREFE_CMDS,
+    NUM_SREFX_CMDS,
+    HBM_DUAL_CMDS,
+    SIZE
+};
+
+// Built-in vector counters, same convention as Counter
+enum class VecCounter {
+    ALL_BANK_IDLE_CYCLES,
+    RANK_ACTIVE_CYCLES,
+    SREF_CYCLES,
+    SIZE
+};
+
+// Built-in histograms, same convention as Counter
+enum class Histogram { READ_LATENCY, WRITE_LATENCY, INTERARRIVAL_LATENCY, SIZE };
+
+// Log-linear histogram in the spirit of HdrHistogram: values below
+// 2 * kSubBuckets are counted exactly, every power of 2 range above that is
+// split into kSubBuckets equal buckets, so a recorded value is off by less
+// than 1 / kSubBuckets and adding one is an array increment
+class LatencyHistogram {
+   public:
+    LatencyHistogram() : count_(0), sum_(0), max_(0) {}
+    void Add(uint64_t value);
+    void Merge(const LatencyHistogram& other);
+    void Clear();
+    uint64_t Count() const { return count_; }
+    uint64_t Max() const { return max_; }
+    double Average() const;
+
+    // Value at or below which percentile % of the recorded values are,
+    // reported as the highest value of the bucket it falls into
+    uint64_t ValueAtPercentile(double percentile) const;
+
+    // lowest value and count of every non-empty bucket, in value order
+    std::vector<std::pair<uint64_t, uint64_t> > Buckets() const;
+
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
+
+   private:
+    static const int kSubBucketBits = 7;
+    static const uint64_t kSubBuckets = 1 << kSubBucketBits;
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketLowest(int index);
+    static uint64_t BucketHighest(int index);
+
+    // grown on demand up to the highest bucket seen
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
+
 class SimpleStats {
    public:
     SimpleStats(const Config& config, int channel_id);
     // incrementing counter
-    void Increment(const std::string name) { epoch_counters_[name] += 1; }
+    void Increment(Counter id) { epoch_counter_vals_[static_cast<int>(id)]++; }
+    void Increment(const std::string& name) {
+        epoch_counter_vals_[counter_ids_.at(name)]++;
+    }
+
+    // increment counter by number
+    void IncrementBy(Counter id, uint64_t num) {
+        epoch_counter_vals_[static_cast<int>(id)] += num;
+    }
+    void IncrementBy(const std::string& name, uint64_t num) {
+        epoch_counter_vals_[counter_ids_.at(name)] += num;
+    }
 
     // incrementing for vec counter
-    void IncrementVec(const std::string name, int pos) {
-        epoch_vec_counters_[name][pos] += 1;
+    void IncrementVec(VecCounter id, int pos) {
+        epoch_vec_counter_vals_[static_cast<int>(id)][pos]++;
+    }
+    void IncrementVec(const std::string& name, int pos) {
+        epoch_vec_counter_vals_[vec_counter_ids_.at(name)][pos]++;
     }
 
     // increment vec counter by number
-    void IncrementVecBy(const std::string name, int pos, int num) {
-        epoch_vec_counters_[name][pos] += num;
+    void IncrementVecBy(VecCounter id, int pos, uint64_t num) {
+        epoch_vec_counter_vals_[static_cast<int>(id)][pos] += num;
+    }
+    void IncrementVecBy(const std::string& name, int pos, uint64_t num) {
+        epoch_vec_counter_vals_[vec_counter_ids_.at(name)][pos] += num;
     }
 
     // add historgram value
-    void AddValue(const std::string name, const int value);
+    void AddValue(Histogram id, uint64_t value) {
+        epoch_histos_[static_cast<int>(id)].Add(value);
+    }
+    void AddValue(const std::string& name, uint64_t value) {
+        epoch_histos_[histo_ids_.at(name)].Add(value);
+    }
 
     // return per rank background energy
     double RankBackgroundEnergy(const int r) const;
@@ -42,9 +137,12 @@ class SimpleStats {
     // Reset (usually after one phase of simulation)
     void Reset();
 
+    // accumulated and current epoch values, the rest is rebuilt at output
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
+
    private:
     using VecStat = std::unordered_map<std::string, std::vector<uint64_t> >;
-    using HistoCount = std::unordered_map<int, uint64_t>;
     using Json = nlohmann::json;
     void InitStat(std::string name, std::string stat_type,
                   std::string description);
@@ -54,10 +152,12 @@ class SimpleStats {
     void InitHistoStat(std::string name, std::string description, int start_val,
                        int end_val, int num_bins);
 
+    void CollectEpochCounters();
+    void ClearEpochCounters();
     void UpdateCounters();
     void UpdateHistoBins();
     void UpdatePrints(bool epoch);
-    double GetHistoAvg(const HistoCount& histo_counts) const;
+    void UpdatePercentiles(bool epoch);
     std::string GetTextHeader(bool is_final) const;
     void UpdateEpochStats();
     void UpdateFinalStats();
@@ -76,6 +176,16 @@ class SimpleStats {
     VecStat vec_counters_;
     VecStat epoch_vec_counters_;
 
+    // Counters are updated through dense ids assigned by InitStat() and
+    // InitVecStat(), the values are collected into the name indexed epoch
+    // maps above when an epoch is processed
+    std::unordered_map<std::string, int> counter_ids_;
+    std::vector<std::string> counter_names_;
+    std::vector<uint64_t> epoch_counter_vals_;
+    std::unordered_map<std::string, int> vec_counter_ids_;
+    std::vector<std::string> vec_counter_names_;
+    std::vector<std::vector<uint64_t> > epoch_vec_counter_vals_;
+
     // NOTE: doubles_ vec_doubles_ and calculated_ are basically one time
     // placeholders after each epoch they store the value for that epoch
     // (different from the counters) and in the end updated to the overall value
@@ -91,8 +201,10 @@ class SimpleStats {
 
     std::unordered_map<std::string, std::pair<int, int> > histo_bounds_;
     std::unordered_map<std::string, int> bin_widths_;
-    std::unordered_map<std::string, HistoCount> histo_counts_;
-    std::unordered_map<std::string, HistoCount> epoch_histo_counts_;
+    std::unordered_map<std::string, int> histo_ids_;
+    std::vector<std::string> histo_names_;
+    std::vector<LatencyHistogram> histos_;
+    std::vector<LatencyHistogram> epoch_histos_;
     VecStat histo_bins_;
     VecStat epoch_histo_bins_;
 
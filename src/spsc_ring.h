@@ -0,0 +1,71 @@
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+namespace dramsim3 {
+
+// Bounded single producer single consumer ring. Each side keeps a private
+// copy of the other side's index and only reloads the shared one when the
+// copy says the ring is full (or empty), so in the steady state a push or a
+// pop touches no cache line the other thread writes.
+template <typename T>
+class SPSCRing {
+   public:
+    // capacity is rounded up to a power of 2
+    explicit SPSCRing(size_t capacity) : head_(0), tail_(0) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        slots_.reset(new T[size]);
+        cached_head_ = 0;
+        cached_tail_ = 0;
+    }
+    SPSCRing(const SPSCRing&) = delete;
+    SPSCRing& operator=(const SPSCRing&) = delete;
+
+    // producer side
+    bool TryPush(const T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ > mask_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ > mask_) {
+                return false;
+            }
+        }
+        slots_[tail & mask_] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, Front() is nullptr while the ring is empty
+    T* Front() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+    void Pop() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_release);
+    }
+
+   private:
+    std::unique_ptr<T[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_;
+    size_t cached_tail_;  // consumer's copy of tail_
+    alignas(64) std::atomic<size_t> tail_;
+    size_t cached_head_;  // producer's copy of head_
+};
+
+}  // namespace dramsim3
+#endif
@@ -0,0 +1,116 @@
+#include "thread_pool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif  // __linux__
+
+namespace dramsim3 {
+
+// number of polls before a worker goes to sleep on the condition variable
+static const int kSpinCount = 1 << 14;
+
+ThreadPool::ThreadPool(int num_workers, bool pin)
+    : num_workers_(num_workers < 1 ? 1 : num_workers),
+      job_(nullptr),
+      generation_(0),
+      running_(0),
+      stop_(false) {
+    // the calling thread belongs to the user, only pin the spawned workers
+    if (pin && num_workers_ > 1) {
+        cpus_ = AllowedCpus();
+        if (cpus_.size() <= 1) {
+            cpus_.clear();
+        }
+    }
+    threads_.reserve(num_workers_ - 1);
+    for (int i = 1; i < num_workers_; i++) {
+        threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        generation_++;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::Run(const std::function<void(int)>& job) {
+    job_ = &job;
+    running_ = num_workers_ - 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+    }
+    cv_.notify_all();
+    job(0);
+    while (running_.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+    }
+    job_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int worker_id) {
+    PinToCore(worker_id);
+    uint64_t seen = 0;
+    while (true) {
+        int spins = 0;
+        while (generation_.load(std::memory_order_acquire) == seen &&
+               spins < kSpinCount) {
+            spins++;
+        }
+        if (generation_.load(std::memory_order_acquire) == seen) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return generation_.load() != seen; });
+        }
+        seen = generation_.load(std::memory_order_acquire);
+        if (stop_) {
+            return;
+        }
+        (*job_)(worker_id);
+        running_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+std::vector<int> ThreadPool::AllowedCpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpu_set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &cpu_set)) {
+                cpus.push_back(i);
+            }
+        }
+    }
+#endif  // __linux__
+    if (cpus.empty()) {
+        int num_cores = static_cast<int>(std::thread::hardware_concurrency());
+        for (int i = 0; i < num_cores; i++) {
+            cpus.push_back(i);
+        }
+    }
+    return cpus;
+}
+
+void ThreadPool::PinToCore(int worker_id) {
+#ifdef __linux__
+    if (cpus_.empty()) {
+        return;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpus_[worker_id % cpus_.size()], &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+#endif  // __linux__
+    return;
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,47 @@
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dramsim3 {
+
+// A fixed set of worker threads that run the same job in lockstep, the
+// calling thread participates as worker 0 so num_workers - 1 threads are
+// spawned. Workers spin for a while before blocking so that short, frequent
+// jobs (e.g. one sync quantum of DRAM cycles) don't pay for a wake up. With
+// pin the spawned workers are pinned round robin to the CPUs the process may
+// run on, worker i to the i-th one.
+class ThreadPool {
+   public:
+    ThreadPool(int num_workers, bool pin = false);
+    ~ThreadPool();
+    int NumWorkers() const { return num_workers_; }
+    // CPUs in the affinity mask of the process (taskset, cpusets)
+    static std::vector<int> AllowedCpus();
+
+    // run job(worker_id) on every worker and wait for all of them to finish
+    void Run(const std::function<void(int)>& job);
+
+   private:
+    void WorkerLoop(int worker_id);
+    void PinToCore(int worker_id);
+
+    int num_workers_;
+    // empty unless the workers are pinned
+    std::vector<int> cpus_;
+    std::vector<std::thread> threads_;
+    const std::function<void(int)>* job_;
+    std::atomic<uint64_t> generation_;
+    std::atomic<int> running_;
+    std::atomic<bool> stop_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+}  // namespace dramsim3
+#endif
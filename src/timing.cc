@@ -1,9 +1,34 @@
 #include "timing.h"
 #include <algorithm>
+#include <limits>
 #include <utility>
 
 namespace dramsim3 {
 
+// low enough to never win a max() against clk + delay, high enough to not
+// wrap around when clk is added
+const int64_t Timing::kNoConstraint =
+    std::numeric_limits<int64_t>::min() / 4;
+
+namespace {
+
+DelayTable BuildDelayTable(
+    const std::vector<std::vector<std::pair<CommandType, int> > >& lists) {
+    DelayTable table;
+    for (auto& row : table) {
+        row.fill(Timing::kNoConstraint);
+    }
+    for (size_t i = 0; i < lists.size(); i++) {
+        for (auto cmd_timing : lists[i]) {
+            int64_t& delay = table[i][static_cast<int>(cmd_timing.first)];
+            delay = std::max(delay, static_cast<int64_t>(cmd_timing.second));
+        }
+    }
+    return table;
+}
+
+}  // namespace
+
 Timing::Timing(const Config& config)
     : same_bank(static_cast<int>(CommandType::SIZE)),
       other_banks_same_bankgroup(static_cast<int>(CommandType::SIZE)),
@@ -262,6 +287,14 @@ Timing::Timing(const Config& config)
             {CommandType::REFRESH, self_refresh_exit},
             {CommandType::REFRESH_BANK, self_refresh_exit},
             {CommandType::SREF_ENTER, self_refresh_exit}};
+
+    same_bank_delays = BuildDelayTable(same_bank);
+    other_banks_same_bankgroup_delays =
+        BuildDelayTable(other_banks_same_bankgroup);
+    other_bankgroups_same_rank_delays =
+        BuildDelayTable(other_bankgroups_same_rank);
+    other_ranks_delays = BuildDelayTable(other_ranks);
+    same_rank_delays = BuildDelayTable(same_rank);
 }
 
 }  // namespace dramsim3
@@ -1,12 +1,20 @@
 #ifndef __TIMING_H
 #define __TIMING_H
 
+#include <stdint.h>
+#include <array>
 #include <vector>
+#include "bankstate.h"
 #include "common.h"
 #include "configuration.h"
 
 namespace dramsim3 {
 
+// One row of delays per issued command type, indexed by the constrained
+// command type and padded to the bank timing stride
+using DelayRow = std::array<int64_t, BankState::kTimingStride>;
+using DelayTable = std::array<DelayRow, static_cast<int>(CommandType::SIZE)>;
+
 class Timing {
    public:
     Timing(const Config& config);
@@ -17,6 +25,15 @@ class Timing {
         other_bankgroups_same_rank;
     std::vector<std::vector<std::pair<CommandType, int> > > other_ranks;
     std::vector<std::vector<std::pair<CommandType, int> > > same_rank;
+
+    // The lists above expanded to fixed size rows, commands that are not
+    // constrained get kNoConstraint so they can be updated with a plain max()
+    static const int64_t kNoConstraint;
+    DelayTable same_bank_delays;
+    DelayTable other_banks_same_bankgroup_delays;
+    DelayTable other_bankgroups_same_rank_delays;
+    DelayTable other_ranks_delays;
+    DelayTable same_rank_delays;
 };
 
 }  // namespace dramsim3
@@ -0,0 +1,284 @@
+#include "trace_codec.h"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "trace_file.h"
+
+namespace dramsim3 {
+
+namespace {
+const char kCodecMagic[8] = {'D', 'S', '3', 'T', 'R', 'Z', 'I', 'P'};
+const uint32_t kCodecVersion = 1;
+
+enum TokenKind { TOKEN_DELTA = 0, TOKEN_HIT = 1, TOKEN_RUN = 2 };
+
+// a DELTA further than this from every stream starts a new stream instead
+const uint64_t kFarDelta = 1ull << 16;
+
+inline uint64_t ZigZag(uint64_t delta) {
+    return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+inline uint64_t UnZigZag(uint64_t value) {
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+inline void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool GetVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+}  // namespace
+
+TraceEncoder::TraceEncoder() : file_(nullptr), flags_(0), count_(0) {
+    ResetState();
+}
+
+bool TraceEncoder::IsCompressedTrace(const std::string& file_name) {
+    std::ifstream in(file_name, std::ios::binary);
+    char magic[sizeof(kCodecMagic)];
+    return in.read(magic, sizeof(magic)) &&
+           std::memcmp(magic, kCodecMagic, sizeof(magic)) == 0;
+}
+
+bool TraceEncoder::Open(const std::string& file_name, uint32_t flags) {
+    Close();
+    file_ = std::fopen(file_name.c_str(), "wb");
+    if (!file_) {
+        std::cerr << "Can't open " << file_name << std::endl;
+        return false;
+    }
+    flags_ = flags;
+    count_ = 0;
+    ResetState();
+    TraceHeader header;
+    std::memcpy(header.magic, kCodecMagic, sizeof(kCodecMagic));
+    header.version = kCodecVersion;
+    header.flags = flags_;
+    header.count = 0;
+    std::fwrite(&header, sizeof(header), 1, file_);
+    return true;
+}
+
+void TraceEncoder::ResetState() {
+    for (int s = 0; s < kCodecStreams; s++) {
+        last_addrs_[s] = 0;
+        strides_[s] = 0;
+        last_used_[s] = 0;
+    }
+    last_timestamp_ = 0;
+    run_.length = 0;
+    block_count_ = 0;
+    block_.clear();
+}
+
+void TraceEncoder::EmitTag(int kind, int stream, bool is_write) {
+    block_.push_back(static_cast<uint8_t>((kind << 3) | (is_write << 2) |
+                                          stream));
+}
+
+void TraceEncoder::EmitTimestamp(uint64_t step) {
+    if (flags_ & TRACE_TIMESTAMPS) {
+        PutVarint(block_, ZigZag(step));
+    }
+}
+
+void TraceEncoder::FlushRun() {
+    if (run_.length == 1) {
+        EmitTag(TOKEN_HIT, run_.stream, run_.is_write);
+        EmitTimestamp(run_.step);
+    } else if (run_.length > 1) {
+        EmitTag(TOKEN_RUN, run_.stream, run_.is_write);
+        PutVarint(block_, run_.length);
+        EmitTimestamp(run_.step);
+    }
+    run_.length = 0;
+}
+
+void TraceEncoder::Append(uint64_t addr, bool is_write, uint64_t timestamp) {
+    uint64_t step = timestamp - last_timestamp_;
+    int hit = -1;
+    for (int s = 0; s < kCodecStreams; s++) {
+        if (last_addrs_[s] + strides_[s] == addr) {
+            hit = s;
+            // keep extending the current run if it can
+            if (run_.length > 0 && run_.stream == s) {
+                break;
+            }
+        }
+    }
+
+    int stream = hit;
+    if (hit >= 0) {
+        if (run_.length > 0 && run_.stream == hit &&
+            run_.is_write == is_write && run_.step == step) {
+            run_.length++;
+        } else {
+            FlushRun();
+            run_ = Run{hit, is_write, step, 1};
+        }
+    } else {
+        FlushRun();
+        // nearest stream, or the least recently used one if all are far
+        uint64_t nearest = UINT64_MAX;
+        for (int s = 0; s < kCodecStreams; s++) {
+            uint64_t delta = addr - last_addrs_[s];
+            uint64_t distance = static_cast<int64_t>(delta) < 0 ? 0 - delta
+                                                                : delta;
+            if (distance < nearest) {
+                nearest = distance;
+                stream = s;
+            }
+        }
+        if (nearest > kFarDelta) {
+            for (int s = 0; s < kCodecStreams; s++) {
+                if (last_used_[s] < last_used_[stream]) {
+                    stream = s;
+                }
+            }
+        }
+        uint64_t delta = addr - last_addrs_[stream];
+        EmitTag(TOKEN_DELTA, stream, is_write);
+        PutVarint(block_, ZigZag(delta));
+        EmitTimestamp(step);
+        strides_[stream] = delta;
+    }
+    last_addrs_[stream] = addr;
+    last_used_[stream] = count_ + 1;
+    last_timestamp_ = timestamp;
+    count_++;
+    block_count_++;
+    if (block_count_ == kCodecBlockSize) {
+        FlushBlock();
+    }
+}
+
+void TraceEncoder::FlushBlock() {
+    FlushRun();
+    if (block_count_ > 0) {
+        uint32_t sizes[2] = {block_count_, static_cast<uint32_t>(block_.size())};
+        std::fwrite(sizes, sizeof(sizes), 1, file_);
+        std::fwrite(block_.data(), 1, block_.size(), file_);
+    }
+    uint64_t count = count_;
+    ResetState();
+    count_ = count;
+}
+
+void TraceEncoder::Close() {
+    if (!file_) {
+        return;
+    }
+    FlushBlock();
+    std::fseek(file_, offsetof(TraceHeader, count), SEEK_SET);
+    std::fwrite(&count_, sizeof(count_), 1, file_);
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool TraceDecoder::Open(const std::string& file_name) {
+    Close();
+    file_ = std::fopen(file_name.c_str(), "rb");
+    if (!file_) {
+        std::cerr << "Can't open trace " << file_name << std::endl;
+        return false;
+    }
+    TraceHeader header;
+    if (std::fread(&header, sizeof(header), 1, file_) != 1 ||
+        std::memcmp(header.magic, kCodecMagic, sizeof(kCodecMagic)) != 0 ||
+        header.version != kCodecVersion) {
+        std::cerr << "Unsupported compressed trace " << file_name
+                  << std::endl;
+        Close();
+        return false;
+    }
+    flags_ = header.flags;
+    count_ = header.count;
+    return true;
+}
+
+void TraceDecoder::Close() {
+    if (file_) {
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool TraceDecoder::HasTimestamps() const {
+    return (flags_ & TRACE_TIMESTAMPS) != 0;
+}
+
+size_t TraceDecoder::ReadBlock(std::vector<Transaction>& out) {
+    uint32_t sizes[2];
+    if (!file_ || std::fread(sizes, sizeof(sizes), 1, file_) != 1) {
+        return 0;
+    }
+    block_.resize(sizes[1]);
+    if (std::fread(block_.data(), 1, block_.size(), file_) != block_.size()) {
+        std::cerr << "Truncated compressed trace" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+
+    uint64_t last_addrs[kCodecStreams] = {};
+    uint64_t strides[kCodecStreams] = {};
+    uint64_t timestamp = 0;
+    bool has_timestamps = HasTimestamps();
+    const uint8_t* p = block_.data();
+    const uint8_t* end = p + block_.size();
+    size_t first = out.size();
+    out.reserve(first + sizes[0]);
+    bool ok = true;
+    while (ok && p < end) {
+        uint8_t tag = *p++;
+        int stream = tag & 3;
+        bool is_write = (tag >> 2) & 1;
+        int kind = tag >> 3;
+        uint64_t value = 1, step = 0;
+        if (kind == TOKEN_DELTA) {
+            ok = GetVarint(p, end, value);
+            strides[stream] = UnZigZag(value);
+            value = 1;
+        } else if (kind == TOKEN_RUN) {
+            ok = GetVarint(p, end, value);
+        } else if (kind != TOKEN_HIT) {
+            ok = false;
+        }
+        if (ok && has_timestamps) {
+            ok = GetVarint(p, end, step);
+            step = UnZigZag(step);
+        }
+        // a corrupted run length must not expand past the block
+        if (ok && value > sizes[0] - (out.size() - first)) {
+            ok = false;
+        }
+        for (uint64_t i = 0; ok && i < value; i++) {
+            last_addrs[stream] += strides[stream];
+            timestamp += step;
+            out.emplace_back(last_addrs[stream], is_write);
+            out.back().added_cycle = timestamp;
+        }
+    }
+    if (!ok || out.size() - first != sizes[0]) {
+        std::cerr << "Corrupted compressed trace block" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    return sizes[0];
+}
+
+}  // namespace dramsim3
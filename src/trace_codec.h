@@ -0,0 +1,92 @@
+#ifndef __TRACE_CODEC_H
+#define __TRACE_CODEC_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "common.h"
+
+namespace dramsim3 {
+
+// Compressed trace layout: a TraceHeader with the "DS3TRZIP" magic, then
+// blocks of up to kCodecBlockSize requests, each a uint32 request count and
+// a uint32 payload size followed by the payload. The codec state is reset at
+// every block so blocks decode on their own.
+//
+// The payload is a sequence of tokens. Addresses are tracked as
+// kCodecStreams streams, each remembering its last address and stride, and
+// every token starts with a tag byte holding the stream, the op and one of
+//   DELTA  zigzag varint of the address minus the stream's last address,
+//          which becomes the stream's stride
+//   HIT    one request at last address + stride
+//   RUN    varint n, then n HIT requests
+// With TRACE_TIMESTAMPS each token is followed by a zigzag varint of the
+// timestamp minus the previous one, for a RUN the step between its requests.
+const int kCodecStreams = 4;
+const uint32_t kCodecBlockSize = 4096;
+
+class TraceEncoder {
+   public:
+    TraceEncoder();
+    ~TraceEncoder() { Close(); }
+    TraceEncoder(const TraceEncoder&) = delete;
+    TraceEncoder& operator=(const TraceEncoder&) = delete;
+
+    bool Open(const std::string& file_name, uint32_t flags);
+    void Append(uint64_t addr, bool is_write, uint64_t timestamp = 0);
+    void Close();
+
+    static bool IsCompressedTrace(const std::string& file_name);
+
+   private:
+    struct Run {
+        int stream;
+        bool is_write;
+        uint64_t step;
+        uint64_t length;
+    };
+
+    std::FILE* file_;
+    uint32_t flags_;
+    uint64_t count_;
+
+    uint64_t last_addrs_[kCodecStreams];
+    uint64_t strides_[kCodecStreams];
+    uint64_t last_used_[kCodecStreams];
+    uint64_t last_timestamp_;
+    Run run_;
+    uint32_t block_count_;
+    std::vector<uint8_t> block_;
+
+    void ResetState();
+    void EmitTag(int kind, int stream, bool is_write);
+    void EmitTimestamp(uint64_t step);
+    void FlushRun();
+    void FlushBlock();
+};
+
+// Decodes a compressed trace a block at a time
+class TraceDecoder {
+   public:
+    TraceDecoder() : file_(nullptr), flags_(0), count_(0) {}
+    ~TraceDecoder() { Close(); }
+    TraceDecoder(const TraceDecoder&) = delete;
+    TraceDecoder& operator=(const TraceDecoder&) = delete;
+
+    bool Open(const std::string& file_name);
+    void Close();
+    bool HasTimestamps() const;
+    uint64_t Size() const { return count_; }
+    // appends the requests of the next block to out, 0 at the end
+    size_t ReadBlock(std::vector<Transaction>& out);
+
+   private:
+    std::FILE* file_;
+    uint32_t flags_;
+    uint64_t count_;
+    std::vector<uint8_t> block_;
+};
+
+}  // namespace dramsim3
+#endif
@@ -0,0 +1,20 @@
+#include <iostream>
+#include <string>
+#include "trace_file.h"
+
+// Converts a trace between the text, binary (.bin) and compressed (.trz)
+// formats
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <input_trace> <output_trace>\n";
+        std::cerr << "Example: " << argv[0]
+                  << " traces/test.trace traces/test.bin\n";
+        return 1;
+    }
+
+    if (!dramsim3::ConvertTrace(argv[1], argv[2])) {
+        return 1;
+    }
+    std::cout << "[Converter] Trace written to: " << argv[2] << "\n";
+    return 0;
+}
@@ -0,0 +1,265 @@
+#include "trace_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace dramsim3 {
+
+namespace {
+const char kTraceMagic[8] = {'D', 'S', '3', 'T', 'R', 'A', 'C', 'E'};
+
+// "<hex addr> R|W [cycle]", false for lines that aren't a request
+bool ParseTextLine(const std::string& line, uint64_t& record,
+                   uint64_t& timestamp, bool& has_timestamp) {
+    std::istringstream fields(line);
+    uint64_t addr;
+    std::string op;
+    if (!(fields >> std::hex >> addr >> op)) {
+        return false;
+    }
+    has_timestamp = static_cast<bool>(fields >> std::dec >> timestamp);
+    bool is_write = op == "W" || op == "WRITE" || op == "write" ||
+                    op == "P_MEM_WR" || op == "BOFF";
+    record = addr | (is_write ? kTraceWriteBit : 0);
+    return true;
+}
+}  // namespace
+
+TraceFile::TraceFile()
+    : records_(nullptr), count_(0), stride_(1), map_(nullptr), map_size_(0) {}
+
+TraceFile::~TraceFile() { Close(); }
+
+bool TraceFile::IsBinaryTrace(const std::string& file_name) {
+    std::ifstream in(file_name, std::ios::binary);
+    char magic[sizeof(kTraceMagic)];
+    return in.read(magic, sizeof(magic)) &&
+           std::memcmp(magic, kTraceMagic, sizeof(magic)) == 0;
+}
+
+void TraceFile::Close() {
+    if (map_) {
+        munmap(map_, map_size_);
+        map_ = nullptr;
+        map_size_ = 0;
+    }
+    records_ = nullptr;
+    count_ = 0;
+    stride_ = 1;
+}
+
+bool TraceFile::Open(const std::string& file_name) {
+    Close();
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Can't open trace " << file_name << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(TraceHeader)) {
+        std::cerr << "Truncated trace " << file_name << std::endl;
+        close(fd);
+        return false;
+    }
+    map_size_ = st.st_size;
+    map_ = mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map_ == MAP_FAILED) {
+        std::cerr << "Can't mmap trace " << file_name << std::endl;
+        map_ = nullptr;
+        map_size_ = 0;
+        return false;
+    }
+    // records are only ever walked front to back
+    madvise(map_, map_size_, MADV_SEQUENTIAL);
+
+    const auto* header = static_cast<const TraceHeader*>(map_);
+    stride_ = (header->flags & TRACE_TIMESTAMPS) ? 2 : 1;
+    uint64_t max_count =
+        (map_size_ - sizeof(TraceHeader)) / (stride_ * sizeof(uint64_t));
+    if (std::memcmp(header->magic, kTraceMagic, sizeof(kTraceMagic)) != 0 ||
+        header->version != kTraceVersion || header->count > max_count) {
+        std::cerr << "Unsupported or truncated trace " << file_name
+                  << std::endl;
+        Close();
+        return false;
+    }
+    count_ = header->count;
+    records_ = reinterpret_cast<const uint64_t*>(header + 1);
+    return true;
+}
+
+bool TraceReader::Open(const std::string& file_name) {
+    next_ = 0;
+    decoded_.clear();
+    decoded_pos_ = 0;
+    if (TraceFile::IsBinaryTrace(file_name)) {
+        format_ = BINARY;
+        bool ok = mapped_.Open(file_name);
+        has_timestamps_ = mapped_.HasTimestamps();
+        return ok;
+    }
+    if (TraceEncoder::IsCompressedTrace(file_name)) {
+        format_ = COMPRESSED;
+        bool ok = decoder_.Open(file_name);
+        has_timestamps_ = decoder_.HasTimestamps();
+        return ok;
+    }
+    format_ = TEXT;
+    text_.open(file_name);
+    if (!text_) {
+        std::cerr << "Can't open trace " << file_name << std::endl;
+        return false;
+    }
+    return true;
+}
+
+size_t TraceReader::Read(std::vector<Transaction>& out, size_t max_count) {
+    size_t count = 0;
+    if (format_ == BINARY) {
+        for (; count < max_count && next_ < mapped_.Size(); count++) {
+            out.emplace_back(mapped_.Addr(next_), mapped_.IsWrite(next_));
+            out.back().added_cycle = mapped_.Timestamp(next_);
+            next_++;
+        }
+        return count;
+    }
+    if (format_ == COMPRESSED) {
+        while (count < max_count) {
+            if (decoded_pos_ == decoded_.size()) {
+                decoded_.clear();
+                decoded_pos_ = 0;
+                if (decoder_.ReadBlock(decoded_) == 0) {
+                    break;
+                }
+            }
+            size_t n = std::min(max_count - count,
+                                decoded_.size() - decoded_pos_);
+            out.insert(out.end(), decoded_.begin() + decoded_pos_,
+                       decoded_.begin() + decoded_pos_ + n);
+            decoded_pos_ += n;
+            count += n;
+        }
+        return count;
+    }
+    std::string line;
+    while (count < max_count && std::getline(text_, line)) {
+        uint64_t record, timestamp;
+        bool has_timestamp;
+        if (ParseTextLine(line, record, timestamp, has_timestamp)) {
+            if (next_ == 0) {
+                has_timestamps_ = has_timestamp;
+            }
+            out.emplace_back(record & ~kTraceWriteBit,
+                             (record & kTraceWriteBit) != 0);
+            out.back().added_cycle = has_timestamp ? timestamp : 0;
+            next_++;
+            count++;
+        }
+    }
+    return count;
+}
+
+bool TraceWriter::Open(const std::string& file_name, uint32_t flags) {
+    Close();
+    file_ = std::fopen(file_name.c_str(), "wb");
+    if (!file_) {
+        std::cerr << "Can't open " << file_name << std::endl;
+        return false;
+    }
+    flags_ = flags;
+    count_ = 0;
+    TraceHeader header;
+    std::memcpy(header.magic, kTraceMagic, sizeof(kTraceMagic));
+    header.version = kTraceVersion;
+    header.flags = flags_;
+    header.count = 0;
+    std::fwrite(&header, sizeof(header), 1, file_);
+    return true;
+}
+
+void TraceWriter::Append(uint64_t addr, bool is_write, uint64_t timestamp) {
+    uint64_t record[2] = {addr | (is_write ? kTraceWriteBit : 0), timestamp};
+    std::fwrite(record, sizeof(uint64_t),
+                (flags_ & TRACE_TIMESTAMPS) ? 2 : 1, file_);
+    count_++;
+}
+
+void TraceWriter::Close() {
+    if (!file_) {
+        return;
+    }
+    std::fseek(file_, offsetof(TraceHeader, count), SEEK_SET);
+    std::fwrite(&count_, sizeof(count_), 1, file_);
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+bool ConvertTrace(const std::string& in_file, const std::string& out_file) {
+    TraceReader reader;
+    if (!reader.Open(in_file)) {
+        return false;
+    }
+    auto has_extension = [&out_file](const std::string& ext) {
+        return out_file.size() >= ext.size() &&
+               out_file.compare(out_file.size() - ext.size(), ext.size(),
+                                ext) == 0;
+    };
+
+    // the first chunk tells whether a text trace has timestamps
+    std::vector<Transaction> chunk;
+    reader.Read(chunk, kCodecBlockSize);
+    uint32_t flags = reader.HasTimestamps() ? TRACE_TIMESTAMPS : 0;
+
+    TraceWriter writer;
+    TraceEncoder encoder;
+    std::ofstream text;
+    if (has_extension(".bin")) {
+        if (!writer.Open(out_file, flags)) {
+            return false;
+        }
+    } else if (has_extension(".trz")) {
+        if (!encoder.Open(out_file, flags)) {
+            return false;
+        }
+    } else {
+        text.open(out_file);
+        if (!text) {
+            std::cerr << "Can't open " << out_file << std::endl;
+            return false;
+        }
+    }
+
+    char line[64];
+    while (!chunk.empty()) {
+        for (const auto& trans : chunk) {
+            if (has_extension(".bin")) {
+                writer.Append(trans.addr, trans.is_write, trans.added_cycle);
+            } else if (has_extension(".trz")) {
+                encoder.Append(trans.addr, trans.is_write, trans.added_cycle);
+            } else {
+                int len = std::snprintf(line, sizeof(line), "0x%08" PRIx64 " %s",
+                                        trans.addr, trans.is_write ? "W" : "R");
+                text.write(line, len);
+                if (flags & TRACE_TIMESTAMPS) {
+                    text << " " << trans.added_cycle;
+                }
+                text << "\n";
+            }
+        }
+        chunk.clear();
+        reader.Read(chunk, kCodecBlockSize);
+    }
+    return true;
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,114 @@
+#ifndef __TRACE_FILE_H
+#define __TRACE_FILE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "trace_codec.h"
+
+namespace dramsim3 {
+
+// Binary trace layout: a TraceHeader followed by header.count records of
+// one or two little endian 64 bit words. The first word is the address with
+// the write flag in the top bit, the second (TRACE_TIMESTAMPS only) is the
+// cycle the request is issued at.
+const uint32_t kTraceVersion = 1;
+const uint64_t kTraceWriteBit = 1ull << 63;
+
+enum TraceFlags : uint32_t { TRACE_TIMESTAMPS = 1 << 0 };
+
+struct TraceHeader {
+    char magic[8];  // "DS3TRACE"
+    uint32_t version;
+    uint32_t flags;
+    uint64_t count;
+};
+
+// Read only view of a binary trace, mmap'ed and walked in place
+class TraceFile {
+   public:
+    TraceFile();
+    ~TraceFile();
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    bool Open(const std::string& file_name);
+    void Close();
+
+    uint64_t Size() const { return count_; }
+    bool HasTimestamps() const { return stride_ == 2; }
+    uint64_t Addr(uint64_t i) const {
+        return records_[i * stride_] & ~kTraceWriteBit;
+    }
+    bool IsWrite(uint64_t i) const {
+        return (records_[i * stride_] & kTraceWriteBit) != 0;
+    }
+    uint64_t Timestamp(uint64_t i) const {
+        return stride_ == 2 ? records_[i * 2 + 1] : 0;
+    }
+
+    static bool IsBinaryTrace(const std::string& file_name);
+
+   private:
+    const uint64_t* records_;
+    uint64_t count_;
+    int stride_;
+    void* map_;
+    size_t map_size_;
+};
+
+// Sequential reader handing out a trace a chunk at a time, so only the
+// chunk being processed is ever held in memory, whatever the trace size.
+// Reads text, binary and compressed (trace_codec.h) traces, timestamps end
+// up in added_cycle.
+class TraceReader {
+   public:
+    TraceReader()
+        : format_(TEXT), next_(0), decoded_pos_(0), has_timestamps_(false) {}
+    bool Open(const std::string& file_name);
+    // appends up to max_count transactions to out, returns how many were
+    // read, 0 at the end of the trace
+    size_t Read(std::vector<Transaction>& out, size_t max_count);
+    // for text traces only known once the first request was read
+    bool HasTimestamps() const { return has_timestamps_; }
+
+   private:
+    enum Format { TEXT, BINARY, COMPRESSED };
+    Format format_;
+    TraceFile mapped_;  // binary traces
+    uint64_t next_;
+    TraceDecoder decoder_;  // compressed traces
+    std::vector<Transaction> decoded_;
+    size_t decoded_pos_;
+    std::ifstream text_;  // text traces
+    bool has_timestamps_;
+};
+
+// Writes a binary trace, the record count is filled in on Close()
+class TraceWriter {
+   public:
+    TraceWriter() : file_(nullptr), flags_(0), count_(0) {}
+    ~TraceWriter() { Close(); }
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    bool Open(const std::string& file_name, uint32_t flags);
+    void Append(uint64_t addr, bool is_write, uint64_t timestamp = 0);
+    void Close();
+
+   private:
+    std::FILE* file_;
+    uint32_t flags_;
+    uint64_t count_;
+};
+
+// Converts between trace formats, the input format is detected and the
+// output one follows the extension: .bin binary, .trz compressed, else text
+
+bool ConvertTrace(const std::string& in_file, const std::string& out_file);
+
+}  // namespace dramsim3
+#endif
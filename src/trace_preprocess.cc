@@ -0,0 +1,148 @@
+#include "trace_preprocess.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace dramsim3 {
+
+namespace {
+bool AddrLess(const Transaction& a, const Transaction& b) {
+    return a.addr < b.addr;
+}
+
+// takes one request from every non empty list in turn until all are empty
+template <typename List>
+void RoundRobin(std::vector<List>& lists, std::vector<Transaction>& out) {
+    std::vector<size_t> next(lists.size(), 0);
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (size_t i = 0; i < lists.size(); i++) {
+            if (next[i] < lists[i].size()) {
+                out.push_back(lists[i][next[i]++]);
+                progress = true;
+            }
+        }
+    }
+}
+}  // namespace
+
+TraceOrder GetTraceOrder(const std::string& order_str) {
+    if (order_str == "address") {
+        return TraceOrder::ADDRESS;
+    } else if (order_str == "bank") {
+        return TraceOrder::BANK_ROUND_ROBIN;
+    } else if (order_str == "bankgroup") {
+        return TraceOrder::BANKGROUP_INTERLEAVE;
+    }
+    return TraceOrder::SIZE;
+}
+
+TracePreprocessor::TracePreprocessor(const Config& config, TraceOrder order,
+                                     int channels_per_queue, int num_threads)
+    : config_(config),
+      order_(order),
+      channels_per_queue_(channels_per_queue),
+      num_queues_(0),
+      pool_(num_threads),
+      channels_(config.channels) {
+    if (channels_per_queue_ < 1 || config_.channels % channels_per_queue_) {
+        std::cerr << channels_per_queue_ << " channels per queue don't divide "
+                  << config_.channels << " channels" << std::endl;
+        AbruptExit(__FILE__, __LINE__);
+    }
+    num_queues_ = config_.channels / channels_per_queue_;
+}
+
+int TracePreprocessor::BankIndex(const Address& addr) const {
+    return (addr.rank * config_.bankgroups + addr.bankgroup) *
+               config_.banks_per_group +
+           addr.bank;
+}
+
+void TracePreprocessor::Process(const std::vector<Transaction>& trace,
+                                std::vector<std::deque<Transaction>>& queues) {
+    int num_workers = pool_.NumWorkers();
+
+    // decode in slices, one per worker
+    decoded_.resize(trace.size());
+    pool_.Run([&](int worker_id) {
+        size_t first = trace.size() * worker_id / num_workers;
+        size_t last = trace.size() * (worker_id + 1) / num_workers;
+        for (size_t i = first; i < last; i++) {
+            decoded_[i] = trace[i];
+            decoded_[i].mapped_addr = config_.AddressMapping(trace[i].addr);
+        }
+    });
+
+    // split by channel, keeping the trace order within each channel
+    for (auto& channel : channels_) {
+        channel.clear();
+    }
+    for (const auto& trans : decoded_) {
+        channels_[trans.mapped_addr.channel].push_back(trans);
+    }
+
+    // channels and then queues are handed out to whichever worker is free
+    std::atomic<int> next_channel(0);
+    pool_.Run([&](int worker_id) {
+        int ch;
+        while ((ch = next_channel.fetch_add(1)) < config_.channels) {
+            OrderChannel(channels_[ch]);
+        }
+    });
+
+    queues.resize(num_queues_);
+    std::atomic<int> next_queue(0);
+    pool_.Run([&](int worker_id) {
+        int q;
+        std::vector<Transaction> merged;
+        while ((q = next_queue.fetch_add(1)) < num_queues_) {
+            auto first = channels_.begin() + q * channels_per_queue_;
+            std::vector<std::vector<Transaction>> group(
+                std::make_move_iterator(first),
+                std::make_move_iterator(first + channels_per_queue_));
+            merged.clear();
+            RoundRobin(group, merged);
+            queues[q].insert(queues[q].end(), merged.begin(), merged.end());
+        }
+    });
+    return;
+}
+
+void TracePreprocessor::OrderChannel(std::vector<Transaction>& trans) const {
+    if (order_ == TraceOrder::ADDRESS) {
+        std::sort(trans.begin(), trans.end(), AddrLess);
+        return;
+    }
+
+    std::vector<std::vector<Transaction>> banks(config_.ranks * config_.banks);
+    for (const auto& t : trans) {
+        banks[BankIndex(t.mapped_addr)].push_back(t);
+    }
+    for (auto& bank : banks) {
+        std::sort(bank.begin(), bank.end(), AddrLess);
+    }
+
+    trans.clear();
+    if (order_ == TraceOrder::BANK_ROUND_ROBIN) {
+        RoundRobin(banks, trans);
+        return;
+    }
+
+    // BANKGROUP_INTERLEAVE, banks are grouped consecutively by BankIndex()
+    std::vector<std::vector<Transaction>> bankgroups(config_.ranks *
+                                                     config_.bankgroups);
+    for (size_t bg = 0; bg < bankgroups.size(); bg++) {
+        std::vector<std::vector<Transaction>> group(
+            std::make_move_iterator(banks.begin() +
+                                    bg * config_.banks_per_group),
+            std::make_move_iterator(banks.begin() +
+                                    (bg + 1) * config_.banks_per_group));
+        RoundRobin(group, bankgroups[bg]);
+    }
+    RoundRobin(bankgroups, trans);
+    return;
+}
+
+}  // namespace dramsim3
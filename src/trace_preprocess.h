@@ -0,0 +1,53 @@
+#ifndef __TRACE_PREPROCESS_H
+#define __TRACE_PREPROCESS_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "configuration.h"
+#include "thread_pool.h"
+
+namespace dramsim3 {
+
+// How the requests of one channel are ordered
+enum class TraceOrder {
+    ADDRESS,               // sorted by address for row buffer locality
+    BANK_ROUND_ROBIN,      // sorted per bank, banks take turns
+    BANKGROUP_INTERLEAVE,  // sorted per bank, banks take turns within a
+                           // bank group and bank groups take turns
+    SIZE
+};
+
+// "address", "bank" or "bankgroup", SIZE for anything else
+TraceOrder GetTraceOrder(const std::string& order_str);
+
+// Splits trace requests into one queue per group of channels_per_queue
+// consecutive channels (e.g. the two pseudo channels of an HBM channel),
+// orders the requests of every channel and lets the channels of a queue
+// take turns. Address decoding is split across the worker threads and every
+// channel is ordered on its own, in parallel.
+class TracePreprocessor {
+   public:
+    TracePreprocessor(const Config& config, TraceOrder order,
+                      int channels_per_queue, int num_threads);
+    int NumQueues() const { return num_queues_; }
+    // queues is resized to NumQueues() and the requests appended
+    void Process(const std::vector<Transaction>& trace,
+                 std::vector<std::deque<Transaction>>& queues);
+
+   private:
+    const Config& config_;
+    TraceOrder order_;
+    int channels_per_queue_;
+    int num_queues_;
+    ThreadPool pool_;
+    std::vector<Transaction> decoded_;
+    std::vector<std::vector<Transaction>> channels_;
+
+    void OrderChannel(std::vector<Transaction>& trans) const;
+    int BankIndex(const Address& addr) const;
+};
+
+}  // namespace dramsim3
+#endif
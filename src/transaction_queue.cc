@@ -0,0 +1,118 @@
+#include "transaction_queue.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace dramsim3 {
+
+TransactionQueue::TransactionQueue(int num_buckets, size_t capacity)
+    : capacity_(capacity),
+      size_(0),
+      next_seq_(0),
+      buckets_(num_buckets, Bucket{-1, -1, -1}),
+      free_node_(-1) {
+    active_buckets_.reserve(num_buckets);
+    nodes_.reserve(capacity);
+}
+
+void TransactionQueue::Push(int bucket, const Transaction& trans) {
+    int node = free_node_;
+    if (node >= 0) {
+        free_node_ = nodes_[node].next;
+        nodes_[node].trans = trans;
+    } else {
+        node = static_cast<int>(nodes_.size());
+        nodes_.push_back(Node{trans, 0, -1});
+    }
+    nodes_[node].seq = next_seq_++;
+    nodes_[node].next = -1;
+
+    auto& b = buckets_[bucket];
+    if (b.head < 0) {
+        b.head = node;
+        b.active_pos = static_cast<int>(active_buckets_.size());
+        active_buckets_.push_back(bucket);
+    } else {
+        nodes_[b.tail].next = node;
+    }
+    b.tail = node;
+    size_++;
+    return;
+}
+
+int TransactionQueue::OldestSchedulableBucket(
+    const CommandQueue& cmd_queue) const {
+    int oldest = -1;
+    uint64_t oldest_seq = 0;
+    for (int bucket : active_buckets_) {
+        uint64_t seq = nodes_[buckets_[bucket].head].seq;
+        if ((oldest < 0 || seq < oldest_seq) &&
+            cmd_queue.WillAcceptCommand(bucket)) {
+            oldest = bucket;
+            oldest_seq = seq;
+        }
+    }
+    return oldest;
+}
+
+void TransactionQueue::Pop(int bucket) {
+    auto& b = buckets_[bucket];
+    int node = b.head;
+    b.head = nodes_[node].next;
+    nodes_[node].next = free_node_;
+    free_node_ = node;
+    size_--;
+    if (b.head < 0) {
+        // swap the bucket out of the active list
+        int last = active_buckets_.back();
+        active_buckets_[b.active_pos] = last;
+        buckets_[last].active_pos = b.active_pos;
+        active_buckets_.pop_back();
+        b.tail = -1;
+        b.active_pos = -1;
+    }
+    return;
+}
+
+void TransactionQueue::Checkpoint(CheckpointWriter& out) const {
+    // (seq, bucket, node) of every transaction, oldest first
+    std::vector<std::pair<uint64_t, std::pair<int, int> > > entries;
+    entries.reserve(size_);
+    for (int bucket : active_buckets_) {
+        for (int node = buckets_[bucket].head; node >= 0;
+             node = nodes_[node].next) {
+            entries.push_back(
+                std::make_pair(nodes_[node].seq, std::make_pair(bucket, node)));
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    out.Put(next_seq_);
+    out.Put(static_cast<uint64_t>(entries.size()));
+    for (const auto& entry : entries) {
+        out.Put(entry.first);
+        out.Put(entry.second.first);
+        out.Put(nodes_[entry.second.second].trans);
+    }
+}
+
+void TransactionQueue::Restore(CheckpointReader& in) {
+    uint64_t next_seq;
+    in.Get(next_seq);
+    size_t num_entries = in.GetSize();
+    for (size_t i = 0; i < num_entries; i++) {
+        int bucket;
+        Transaction trans;
+        in.Get(next_seq_);
+        in.Get(bucket);
+        in.Get(trans);
+        if (bucket < 0 || bucket >= static_cast<int>(buckets_.size())) {
+            std::cerr << "Checkpoint has a transaction for queue " << bucket
+                      << " out of " << buckets_.size() << std::endl;
+            AbruptExit(__FILE__, __LINE__);
+        }
+        Push(bucket, trans);
+    }
+    next_seq_ = next_seq;
+}
+
+}  // namespace dramsim3
@@ -0,0 +1,58 @@
+#ifndef __TRANSACTION_QUEUE_H
+#define __TRANSACTION_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+#include "checkpoint.h"
+#include "command_queue.h"
+#include "common.h"
+
+namespace dramsim3 {
+
+// Transactions waiting to be scheduled, bucketed by the command queue they
+// map to. Each bucket is a FIFO threaded through a pooled node array and a
+// sequence number keeps the arrival order across buckets, so finding the
+// oldest transaction that fits into the command queues only looks at the
+// head of each non-empty bucket.
+class TransactionQueue {
+   public:
+    TransactionQueue(int num_buckets, size_t capacity);
+    size_t Size() const { return size_; }
+    size_t Capacity() const { return capacity_; }
+    void Push(int bucket, const Transaction& trans);
+
+    // bucket of the oldest transaction whose command queue has room, -1 if
+    // there is none
+    int OldestSchedulableBucket(const CommandQueue& cmd_queue) const;
+    const Transaction& Front(int bucket) const {
+        return nodes_[buckets_[bucket].head].trans;
+    }
+    void Pop(int bucket);
+
+    // Restore() expects an empty queue
+    void Checkpoint(CheckpointWriter& out) const;
+    void Restore(CheckpointReader& in);
+
+   private:
+    struct Node {
+        Transaction trans;
+        uint64_t seq;
+        int next;
+    };
+    struct Bucket {
+        int head;  // -1 for an empty bucket
+        int tail;
+        int active_pos;  // position in active_buckets_
+    };
+
+    size_t capacity_;
+    size_t size_;
+    uint64_t next_seq_;
+    std::vector<Bucket> buckets_;
+    std::vector<int> active_buckets_;
+    std::vector<Node> nodes_;
+    int free_node_;
+};
+
+}  // namespace dramsim3
+#endif